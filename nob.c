@@ -1,6 +1,7 @@
 #define NOB_IMPLEMENTATION
 #define NOB_STRIP_PREFIX
 #include "src/nob.h"
+#include <time.h>
 
 static const char *compiler = "cc";
 
@@ -9,12 +10,62 @@ static const char * input_paths[] = {
 	"src/types.c",
 	"src/error.c",
 	"src/linter.c",
+	"src/bytecode.c",
+	"src/verifier.c",
+	"src/output.c",
+	"src/regvm.c",
+	"src/x86.c",
+	"src/elf64.c",
+	"src/cache.c",
+	"src/cbackend.c",
+	"src/dwarf.c",
+	"src/report.c",
+	"src/perfcounters.c",
 	"src/compiler.c",
+	"src/jit.c",
 	"src/interpreter.c"
 };
 
 static const char *output = "minos";
 
+static const char *bench_dir = "bench";
+
+static const char *bench_vms[] = {
+	"--vm=switch",
+	"--vm=threaded",
+	"--vm=tos",
+	"--vm=reg",
+	"--vm=tiered",
+};
+
+static double now_secs(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Runs every program in bench/ under every interpreter mode, output goes to /dev/null
+static bool run_benchmarks(void) {
+  File_Paths children = {0};
+  if (!read_entire_dir(bench_dir, &children)) return false;
+
+  Cmd cmd = {0};
+  for (size_t i = 0; i < children.count; i++) {
+    if (!sv_end_with(sv_from_cstr(children.items[i]), ".minos")) continue;
+    const char *path = temp_sprintf("%s/%s", bench_dir, children.items[i]);
+    for (size_t j = 0; j < ARRAY_LEN(bench_vms); j++) {
+      Fd fdout = fd_open_for_write("/dev/null");
+      if (fdout == INVALID_FD) return false;
+      cmd_append(&cmd, temp_sprintf("./%s", output), "run", bench_vms[j], path);
+      double start = now_secs();
+      if (!cmd_run_sync_redirect_and_reset(&cmd, (Cmd_Redirect) { .fdout = &fdout })) return false;
+      nob_log(INFO, "%-24s %-16s %.3fs", path, bench_vms[j], now_secs() - start);
+    }
+  }
+  cmd_free(cmd);
+  return true;
+}
+
 int main(int argc, char **argv) {
   NOB_GO_REBUILD_URSELF(argc, argv);
 
@@ -43,6 +94,9 @@ int main(int argc, char **argv) {
       da_append_many(&cmd, argv, argc);
       if (!cmd_run_sync(cmd))
         return 1;
+    } else if (strcmp(subcmd, "-b") == 0) {
+      if (!run_benchmarks())
+        return 1;
     } else if (strcmp(subcmd, "-d") == 0) {
       Cmd cmd = {0};
       cmd_append(&cmd, "gdb");
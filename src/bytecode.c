@@ -0,0 +1,225 @@
+#include "bytecode.h"
+
+#include "nob.h"
+
+static const OpCode opcodeLookup[] = {
+	[TOK_PUSH] = OP_PUSH,
+	[TOK_PLUS] = OP_PLUS,
+	[TOK_MINUS] = OP_MINUS,
+	[TOK_MULTIPLY] = OP_MULTIPLY,
+	[TOK_DIVIDE] = OP_DIVIDE,
+	[TOK_DUMP] = OP_DUMP,
+	[TOK_EQUAL] = OP_EQUAL,
+	[TOK_DUP] = OP_DUP,
+	[TOK_GT] = OP_GT,
+	[TOK_LT] = OP_LT,
+};
+
+static void emitOp(Bytecode * bytecode, OpCode opcode, int32_t operand, size_t origin)
+{
+	Op op = {0};
+	op.opcode = opcode;
+	op.operand = operand;
+	nob_da_append(&bytecode->ops, op);
+	nob_da_append(&bytecode->origins, origin);
+}
+
+// 'while' does nothing and the 'end' of an 'if' only falls through to the next instruction,
+// neither of them makes it into the bytecode
+static bool isMarker(const InstructionArray * instructions, size_t i)
+{
+	Instruction instruction = instructions->items[i];
+	return instruction.token.type == TOK_WHILE || (instruction.token.type == TOK_END && (size_t)instruction.value.i32 > i);
+}
+
+void lowerInstructions(const InstructionArray * instructions, Bytecode * bytecode)
+{
+	bytecode->instructions = instructions;
+
+	// Index of the op that runs first once control reaches instruction i
+	size_t * remap = malloc((instructions->count + 1) * sizeof(*remap));
+	assert(remap != NULL && "Buy more RAM lol");
+	size_t count = 0;
+	for (size_t i = 0; i < instructions->count; i++) {
+		remap[i] = count;
+		if (!isMarker(instructions, i)) count++;
+	}
+	remap[instructions->count] = count;
+
+	for (size_t i = 0; i < instructions->count; i++) {
+		Instruction instruction = instructions->items[i];
+		if (isMarker(instructions, i)) continue;
+		switch (instruction.token.type) {
+		case TOK_IF:
+		case TOK_DO:
+			emitOp(bytecode, OP_JZ, remap[instruction.value.i32], i);
+			break;
+		case TOK_ELSE:
+		case TOK_END:
+			emitOp(bytecode, OP_JMP, remap[instruction.value.i32], i);
+			break;
+		default:
+			switch (instruction.value.type) {
+			case I32:
+				emitOp(bytecode, opcodeLookup[instruction.token.type], instruction.value.i32, i);
+				break;
+			default:
+				assert(false && "Unreachable");
+				break;
+			}
+			break;
+		}
+	}
+	// Jumps past the last instruction land here, so the interpreter never has to bounds check ip
+	emitOp(bytecode, OP_HALT, 0, instructions->count);
+	free(remap);
+}
+
+// OP_PUSH is never the result of a fusion, so 0 doubles as "doesn't fuse" in these tables,
+// the extra slot at OP_COUNT covers ops that fusible() refused
+static const OpCode pushFusions[OP_COUNT + 1] = {
+	[OP_PLUS] = OP_PUSH_PLUS,
+	[OP_MINUS] = OP_PUSH_MINUS,
+	[OP_MULTIPLY] = OP_PUSH_MULTIPLY,
+	[OP_DIVIDE] = OP_PUSH_DIVIDE,
+	[OP_EQUAL] = OP_PUSH_EQUAL,
+	[OP_GT] = OP_PUSH_GT,
+	[OP_LT] = OP_PUSH_LT,
+};
+
+static const OpCode compareJzFusions[OP_COUNT + 1] = {
+	[OP_EQUAL] = OP_EQUAL_JZ,
+	[OP_GT] = OP_GT_JZ,
+	[OP_LT] = OP_LT_JZ,
+};
+
+static const OpCode pushCompareJzFusions[OP_COUNT + 1] = {
+	[OP_EQUAL] = OP_PUSH_EQUAL_JZ,
+	[OP_GT] = OP_PUSH_GT_JZ,
+	[OP_LT] = OP_PUSH_LT_JZ,
+};
+
+static const OpCode dupPushCompareFusions[OP_COUNT + 1] = {
+	[OP_EQUAL] = OP_DUP_PUSH_EQUAL,
+	[OP_GT] = OP_DUP_PUSH_GT,
+	[OP_LT] = OP_DUP_PUSH_LT,
+};
+
+static const OpCode dupPushCompareJzFusions[OP_COUNT + 1] = {
+	[OP_EQUAL] = OP_DUP_PUSH_EQUAL_JZ,
+	[OP_GT] = OP_DUP_PUSH_GT_JZ,
+	[OP_LT] = OP_DUP_PUSH_LT_JZ,
+};
+
+
+// Opcode of the k-th op after ip, as long as the op can be folded into the op at ip
+static OpCode fusible(const Bytecode * bytecode, const bool * isTarget, size_t ip, size_t k)
+{
+	if (ip + k >= bytecode->ops.count || isTarget[ip + k]) return OP_COUNT;
+	return bytecode->ops.items[ip + k].opcode;
+}
+
+// Returns where the jump target of the op lives, NULL if the op doesn't jump
+static int32_t * jumpTarget(Op * ops, size_t ip)
+{
+	switch (ops[ip].opcode) {
+	case OP_JMP:
+	case OP_JZ:
+	case OP_EQUAL_JZ:
+	case OP_GT_JZ:
+	case OP_LT_JZ:
+		return &ops[ip].operand;
+	case OP_PUSH_EQUAL_JZ:
+	case OP_PUSH_GT_JZ:
+	case OP_PUSH_LT_JZ:
+	case OP_DUP_PUSH_EQUAL_JZ:
+	case OP_DUP_PUSH_GT_JZ:
+	case OP_DUP_PUSH_LT_JZ:
+		return &ops[ip + 1].operand;
+	default:
+		return NULL;
+	}
+}
+
+void fuseSuperinstructions(Bytecode * bytecode)
+{
+	size_t count = bytecode->ops.count;
+	bool * isTarget = calloc(count + 1, sizeof(*isTarget));
+	size_t * remap = malloc(count * sizeof(*remap));
+	assert(isTarget != NULL && remap != NULL && "Buy more RAM lol");
+	for (size_t ip = 0; ip < count; ip++) {
+		int32_t * target = jumpTarget(bytecode->ops.items, ip);
+		if (target) isTarget[*target] = true;
+	}
+
+	Bytecode fused = {0};
+	fused.instructions = bytecode->instructions;
+	size_t ip = 0;
+	while (ip < count) {
+		Op op = bytecode->ops.items[ip];
+		size_t origin = bytecode->origins.items[ip];
+		OpCode next[3];
+		for (size_t k = 0; k < NOB_ARRAY_LEN(next); k++) {
+			next[k] = fusible(bytecode, isTarget, ip, k + 1);
+		}
+
+		size_t start = fused.ops.count;
+		size_t length = 1;
+		if (op.opcode == OP_DUP && next[0] == OP_PUSH && dupPushCompareJzFusions[next[1]] && next[2] == OP_JZ) {
+			// dup N > do
+			emitOp(&fused, dupPushCompareJzFusions[next[1]], bytecode->ops.items[ip + 1].operand, origin);
+			emitOp(&fused, OP_EXTRA, bytecode->ops.items[ip + 3].operand, origin);
+			length = 4;
+		} else if (op.opcode == OP_DUP && next[0] == OP_PUSH && dupPushCompareFusions[next[1]]) {
+			// dup N >
+			emitOp(&fused, dupPushCompareFusions[next[1]], bytecode->ops.items[ip + 1].operand, origin);
+			length = 3;
+		} else if (op.opcode == OP_PUSH && pushCompareJzFusions[next[0]] && next[1] == OP_JZ) {
+			// N = if
+			emitOp(&fused, pushCompareJzFusions[next[0]], op.operand, origin);
+			emitOp(&fused, OP_EXTRA, bytecode->ops.items[ip + 2].operand, origin);
+			length = 3;
+		} else if (op.opcode == OP_PUSH && pushFusions[next[0]]) {
+			// N +
+			emitOp(&fused, pushFusions[next[0]], op.operand, origin);
+			length = 2;
+		} else if (compareJzFusions[op.opcode] && next[0] == OP_JZ) {
+			// = if
+			emitOp(&fused, compareJzFusions[op.opcode], bytecode->ops.items[ip + 1].operand, origin);
+			length = 2;
+		} else {
+			emitOp(&fused, op.opcode, op.operand, origin);
+		}
+
+		// Only the first op of a group can be a jump target, the rest never get looked up
+		for (size_t k = 0; k < length; k++) {
+			remap[ip + k] = start;
+		}
+		ip += length;
+	}
+
+	for (size_t i = 0; i < fused.ops.count; i++) {
+		int32_t * target = jumpTarget(fused.ops.items, i);
+		if (target) *target = (int32_t)remap[*target];
+	}
+
+	free(isTarget);
+	free(remap);
+	freeBytecode(bytecode);
+	*bytecode = fused;
+}
+
+Token bytecodeToken(const Bytecode * bytecode, size_t ip, size_t component)
+{
+	size_t origin = bytecode->origins.items[ip] + component;
+	assert(origin < bytecode->instructions->count);
+	return bytecode->instructions->items[origin].token;
+}
+
+void freeBytecode(Bytecode * bytecode)
+{
+	nob_da_free(bytecode->ops);
+	nob_da_free(bytecode->origins);
+	bytecode->ops = (OpArray) {0};
+	bytecode->origins = (IndexStack) {0};
+}
@@ -0,0 +1,71 @@
+#ifndef _BYTECODE_H
+#define _BYTECODE_H
+
+#include "types.h"
+
+typedef enum {
+	OP_PUSH = 0,
+	OP_PLUS,
+	OP_MINUS,
+	OP_MULTIPLY,
+	OP_DIVIDE,
+	OP_DUMP,
+	OP_EQUAL,
+	OP_DUP,
+	OP_GT,
+	OP_LT,
+	// Control flow is lowered to absolute jumps, 'while' and the 'end' of an 'if' disappear
+	OP_JMP,
+	OP_JZ,
+	OP_HALT,
+	// Superinstructions produced by fuseSuperinstructions, the operand of the fused
+	// PUSH is the immediate and the target of the fused JZ goes into an OP_EXTRA
+	// slot right after the op whenever the op needs both
+	OP_PUSH_PLUS,
+	OP_PUSH_MINUS,
+	OP_PUSH_MULTIPLY,
+	OP_PUSH_DIVIDE,
+	OP_PUSH_EQUAL,
+	OP_PUSH_GT,
+	OP_PUSH_LT,
+	OP_EQUAL_JZ,
+	OP_GT_JZ,
+	OP_LT_JZ,
+	OP_PUSH_EQUAL_JZ,
+	OP_PUSH_GT_JZ,
+	OP_PUSH_LT_JZ,
+	OP_DUP_PUSH_EQUAL,
+	OP_DUP_PUSH_GT,
+	OP_DUP_PUSH_LT,
+	OP_DUP_PUSH_EQUAL_JZ,
+	OP_DUP_PUSH_GT_JZ,
+	OP_DUP_PUSH_LT_JZ,
+	OP_EXTRA,
+	OP_COUNT,
+} OpCode;
+
+// Execution only form of an instruction, everything the interpreter needs fits in 8 bytes
+typedef struct {
+	int32_t operand;
+	uint8_t opcode;
+} Op;
+
+typedef struct {
+	Op * items;
+	size_t count;
+	size_t capacity;
+} OpArray;
+
+typedef struct {
+	OpArray ops;
+	IndexStack origins; // Index of the first instruction each op was lowered from, only read when reporting errors
+	const InstructionArray * instructions;
+} Bytecode;
+
+void lowerInstructions(const InstructionArray * instructions, Bytecode * bytecode);
+void fuseSuperinstructions(Bytecode * bytecode);
+// The component picks which of the instructions fused into the op to point at
+Token bytecodeToken(const Bytecode * bytecode, size_t ip, size_t component);
+void freeBytecode(Bytecode * bytecode);
+
+#endif // _BYTECODE_H
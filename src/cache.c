@@ -0,0 +1,176 @@
+#include "cache.h"
+
+#include "nob.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Entries are named after a hash of their key, the key is stored next to the executable and compared in
+// full on every fetch, so two keys with the same hash only ever cost a recompile.
+static uint64_t fnv1a(const char * data, size_t size, uint64_t hash)
+{
+	for (size_t i = 0; i < size; i++) {
+		hash ^= (uint8_t)data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325
+
+const char * cacheDirectory(void)
+{
+	const char * xdg = getenv("XDG_CACHE_HOME");
+	if (xdg && *xdg) return nob_temp_sprintf("%s/minos", xdg);
+	const char * home = getenv("HOME");
+	if (home && *home) return nob_temp_sprintf("%s/.cache/minos", home);
+	return NULL;
+}
+
+// Like mkdir -p, without logging every directory that is already there
+static bool makeDirectories(const char * path)
+{
+	char * copy = strdup(path);
+	assert(copy != NULL && "Buy more RAM lol");
+	bool result = true;
+	for (char * p = copy + 1; ; p++) {
+		if (*p != '/' && *p != '\0') continue;
+		char c = *p;
+		*p = '\0';
+		if (mkdir(copy, 0755) < 0 && errno != EEXIST) {
+			nob_log(NOB_ERROR, "Could not create directory %s: %s", copy, strerror(errno));
+			result = false;
+			break;
+		}
+		*p = c;
+		if (c == '\0') break;
+	}
+	free(copy);
+	return result;
+}
+
+static const char * entryPath(const CacheKey * key, const char * extension)
+{
+	const char * dir = cacheDirectory();
+	if (dir == NULL) return NULL;
+	return nob_temp_sprintf("%s/%016llx%s", dir, (unsigned long long)fnv1a(key->items, key->count, FNV_OFFSET_BASIS), extension);
+}
+
+bool cacheKey(const char * filePath, const char * options, CacheKey * key)
+{
+	Nob_String_Builder source = {0};
+	if (!nob_read_entire_file(filePath, &source)) return false;
+	// A rebuilt minos can generate different code under the same version, so the executable goes in as well
+	Nob_String_Builder self = {0};
+	uint64_t selfHash = 0;
+	if (nob_read_entire_file("/proc/self/exe", &self)) selfHash = fnv1a(self.items, self.count, FNV_OFFSET_BASIS);
+	nob_sb_free(self);
+
+	key->count = 0;
+	nob_sb_append_cstr(key, nob_temp_sprintf("minos %s\ncompiler %016llx\noptions %s\n\n", MINOS_VERSION, (unsigned long long)selfHash, options));
+	nob_sb_append_buf(key, source.items, source.count);
+	nob_sb_free(source);
+	return true;
+}
+
+bool cacheFetch(const CacheKey * key, const char * outPath)
+{
+	const char * keyPath = entryPath(key, ".key");
+	const char * exePath = entryPath(key, "");
+	if (keyPath == NULL) return false;
+
+	int fd = open(keyPath, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	bool same = fstat(fd, &st) == 0 && (size_t)st.st_size == key->count;
+	char * stored = same ? malloc(key->count) : NULL;
+	if (same) {
+		assert(stored != NULL && "Buy more RAM lol");
+		same = read(fd, stored, key->count) == (ssize_t)key->count && memcmp(stored, key->items, key->count) == 0;
+	}
+	free(stored);
+	close(fd);
+	if (!same) return false;
+
+	// The old output goes first, writing through it could change what another link points to
+	if (unlink(outPath) < 0 && errno != ENOENT) return false;
+	if (link(exePath, outPath) < 0) {
+		if (errno == ENOENT) return false;
+		// Links don't cross file systems
+		if (!nob_copy_file(exePath, outPath)) return false;
+	}
+	// Pruning goes by when an entry was last used
+	utimensat(AT_FDCWD, exePath, NULL, 0);
+	utimensat(AT_FDCWD, keyPath, NULL, 0);
+	return true;
+}
+
+// Writes to a private file first and renames it into place, so nobody ever sees half an entry
+static bool storeFile(const char * path, const char * data, size_t size, mode_t mode)
+{
+	const char * tmpPath = nob_temp_sprintf("%s.%d.tmp", path, (int)getpid());
+	int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (fd < 0) return false;
+	size_t written = 0;
+	while (written < size) {
+		ssize_t n = write(fd, data + written, size - written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) break;
+		written += n;
+	}
+	close(fd);
+	if (written < size || rename(tmpPath, path) < 0) {
+		unlink(tmpPath);
+		return false;
+	}
+	return true;
+}
+
+void cacheStore(const CacheKey * key, const char * outPath)
+{
+	const char * dir = cacheDirectory();
+	if (dir == NULL || !makeDirectories(dir)) return;
+	const char * keyPath = entryPath(key, ".key");
+	const char * exePath = entryPath(key, "");
+
+	Nob_String_Builder exe = {0};
+	if (!nob_read_entire_file(outPath, &exe)) return;
+	// The executable goes in before its key, a key on its own would promise something that isn't there
+	bool stored = storeFile(exePath, exe.items, exe.count, 0755) && storeFile(keyPath, key->items, key->count, 0644);
+	nob_sb_free(exe);
+	if (!stored) nob_log(NOB_WARNING, "Could not store %s in the cache at %s", outPath, dir);
+}
+
+bool cachePrune(uint64_t maxAgeDays)
+{
+	const char * dir = cacheDirectory();
+	if (dir == NULL) {
+		nob_log(NOB_ERROR, "Neither XDG_CACHE_HOME nor HOME is set, there is no cache to prune");
+		return false;
+	}
+	// Nothing was ever stored
+	struct stat st;
+	if (stat(dir, &st) < 0 && errno == ENOENT) return true;
+	Nob_File_Paths children = {0};
+	bool result = nob_read_entire_dir(dir, &children);
+	// An age from before 1970 keeps everything instead of wrapping around into the future
+	time_t now = time(NULL);
+	time_t cutoff = maxAgeDays < (uint64_t)now / (24 * 60 * 60) ? now - (time_t)(maxAgeDays * 24 * 60 * 60) : 0;
+	size_t removed = 0;
+	for (size_t i = 0; result && i < children.count; i++) {
+		if (children.items[i][0] == '.') continue;
+		const char * path = nob_temp_sprintf("%s/%s", dir, children.items[i]);
+		if (stat(path, &st) < 0 || !S_ISREG(st.st_mode) || st.st_mtime > cutoff) continue;
+		if (unlink(path) < 0) {
+			nob_log(NOB_ERROR, "Could not remove %s: %s", path, strerror(errno));
+			result = false;
+		}
+		// A key and its executable count as one
+		if (!nob_sv_end_with(nob_sv_from_cstr(children.items[i]), ".key")) removed += 1;
+	}
+	if (result) nob_log(NOB_INFO, "Removed %zu executables from %s", removed, dir);
+	nob_da_free(children);
+	return result;
+}
@@ -0,0 +1,27 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include "types.h"
+
+// How long an executable nobody asked for stays in the cache when pruning without a number of days
+#define CACHE_DEFAULT_MAX_AGE_DAYS 30
+
+typedef struct {
+	char * items;
+	size_t count;
+	size_t capacity;
+} CacheKey;
+
+// $XDG_CACHE_HOME/minos or ~/.cache/minos, NULL when neither variable is set
+const char * cacheDirectory(void);
+// Everything that decides what compiling the file produces: the source, the minos version, the
+// minos executable itself and the codegen options, which are passed in already spelled out
+bool cacheKey(const char * filePath, const char * options, CacheKey * key);
+// Puts the executable stored under key at outPath, hard linked when possible. False on a miss.
+bool cacheFetch(const CacheKey * key, const char * outPath);
+// Keeps a copy of the executable at outPath under key
+void cacheStore(const CacheKey * key, const char * outPath);
+// Removes the executables that weren't stored or fetched in the last maxAgeDays days
+bool cachePrune(uint64_t maxAgeDays);
+
+#endif // _CACHE_H
@@ -0,0 +1,279 @@
+#include "cbackend.h"
+
+#include "error.h"
+#include "output.h"
+#include "verifier.h"
+#include "nob.h"
+
+// The same buffering and formatting as OutputBuffer, so the executable prints exactly what the interpreter does
+static const char * runtime =
+	"#include <signal.h>\n"
+	"#include <stdint.h>\n"
+	"#include <stdlib.h>\n"
+	"#include <unistd.h>\n"
+	"\n"
+	"static char output[OUTPUT_CAPACITY];\n"
+	"static size_t filled;\n"
+	"\n"
+	"static const char digitPairs[201] =\n"
+	"\t\"00010203040506070809101112131415161718192021222324252627282930313233343536373839\"\n"
+	"\t\"40414243444546474849505152535455565758596061626364656667686970717273747576777879\"\n"
+	"\t\"8081828384858687888990919293949596979899\";\n"
+	"\n"
+	"static void flush(void)\n"
+	"{\n"
+	"\tsize_t written = 0;\n"
+	"\twhile (written < filled) {\n"
+	"\t\tssize_t n = write(1, output + written, filled - written);\n"
+	"\t\tif (n <= 0) break;\n"
+	"\t\twritten += n;\n"
+	"\t}\n"
+	"\tfilled = 0;\n"
+	"}\n"
+	"\n"
+	"static void dump(int32_t n)\n"
+	"{\n"
+	"\tif (sizeof(output) - filled < OUTPUT_MAX_LINE) flush();\n"
+	"\tchar digits[OUTPUT_MAX_LINE];\n"
+	"\tchar * p = digits + sizeof(digits);\n"
+	"\t*--p = '\\n';\n"
+	"\tuint32_t magnitude = n < 0 ? 0u - (uint32_t)n : (uint32_t)n;\n"
+	"\twhile (magnitude >= 100) {\n"
+	"\t\tuint32_t pair = magnitude % 100;\n"
+	"\t\tmagnitude /= 100;\n"
+	"\t\tp -= 2;\n"
+	"\t\tp[0] = digitPairs[pair * 2];\n"
+	"\t\tp[1] = digitPairs[pair * 2 + 1];\n"
+	"\t}\n"
+	"\tif (magnitude >= 10) {\n"
+	"\t\tp -= 2;\n"
+	"\t\tp[0] = digitPairs[magnitude * 2];\n"
+	"\t\tp[1] = digitPairs[magnitude * 2 + 1];\n"
+	"\t} else {\n"
+	"\t\t*--p = (char)('0' + magnitude);\n"
+	"\t}\n"
+	"\tif (n < 0) *--p = '-';\n"
+	"\twhile (p < digits + sizeof(digits)) output[filled++] = *p++;\n"
+	"}\n"
+	"\n"
+	// Dividing by zero or INT32_MIN by -1 is undefined in C, the optimizer would be free to turn it into anything.
+	// idiv traps on both, so the interpreter and the native code die of SIGFPE and this has to as well.
+	"static int32_t divide(int32_t a, int32_t b)\n"
+	"{\n"
+	"\tif (b == 0 || (a == INT32_MIN && b == -1)) {\n"
+	"\t\tsignal(SIGFPE, SIG_DFL);\n"
+	"\t\traise(SIGFPE);\n"
+	"\t}\n"
+	"\treturn a / b;\n"
+	"}\n"
+	"\n";
+
+// Paths can have quotes and backslashes in them too
+static void print_string_literal(FILE * out, const char * s)
+{
+	fputc('"', out);
+	for (; *s != '\0'; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') {
+			fprintf(out, "\\%c", c);
+		} else if (c < 0x20 || c == 0x7f) {
+			fprintf(out, "\\%03o", c);
+		} else {
+			fputc(c, out);
+		}
+	}
+	fputc('"', out);
+}
+
+// Only needed when the depths aren't known
+static const char * dynamicStack =
+	"static int32_t * stack;\n"
+	"static size_t capacity;\n"
+	"\n"
+	"static void grow(void)\n"
+	"{\n"
+	"\tcapacity = capacity ? capacity * 2 : 1024;\n"
+	"\tstack = realloc(stack, capacity * sizeof(*stack));\n"
+	"\tif (stack == NULL) abort();\n"
+	"}\n"
+	"\n";
+
+// Reports where the stack ran out the way reportError does in the interpreter
+static void print_underflow(FILE * out, const char * filePath)
+{
+	fprintf(out, "#include <stdio.h>\n\n");
+	fprintf(out, "static void underflow(size_t line, size_t column)\n{\n\tflush();\n");
+	fprintf(out, "\tfprintf(stderr, \"[ERROR] %%s:%%zu:%%zu: %%s\\n\", ");
+	print_string_literal(out, filePath);
+	fprintf(out, ", line, column, ");
+	print_string_literal(out, errorMessage(ERROR_SEGFAULT_POP_FROM_EMPTY_STACK));
+	fprintf(out, ");\n\texit(1);\n}\n\n");
+}
+
+typedef struct {
+	FILE * out;
+	const size_t * depths; // NULL when the items live in the array
+	size_t * stack_count;
+} CEmitter;
+
+// The item fromTop places below the top of the stack at instruction ip, 1 being the top
+static const char * item(CEmitter * e, size_t ip, size_t fromTop)
+{
+	if (e->depths) return nob_temp_sprintf("s%zu", e->depths[ip] - fromTop);
+	return nob_temp_sprintf("stack[sp - %zu]", fromTop);
+}
+
+static bool pop_items(CEmitter * e, Instruction instruction, size_t count)
+{
+	if (e->depths) return true;
+	if (*e->stack_count < count) {
+		reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
+		return false;
+	}
+	*e->stack_count -= count;
+	fprintf(e->out, "\tif (sp < %zu) underflow(%zu, %zu);\n", count, instruction.token.lineNum, instruction.token.colNum);
+	return true;
+}
+
+static void push_item(CEmitter * e, size_t ip, const char * value)
+{
+	if (e->depths) {
+		fprintf(e->out, "\ts%zu = %s;\n", e->depths[ip], value);
+		return;
+	}
+	*e->stack_count += 1;
+	fprintf(e->out, "\tif (sp == capacity) grow();\n");
+	fprintf(e->out, "\tstack[sp] = %s;\n", value);
+	fprintf(e->out, "\tsp += 1;\n");
+}
+
+// Replaces the top two items with format applied to them, lhs first
+static bool binary(CEmitter * e, size_t ip, Instruction instruction, const char * format)
+{
+	if (!pop_items(e, instruction, 2)) return false;
+	const char * lhs = item(e, ip, 2);
+	const char * rhs = item(e, ip, 1);
+	fprintf(e->out, "\t%s = ", lhs);
+	fprintf(e->out, format, lhs, rhs);
+	fprintf(e->out, ";\n");
+	if (e->depths == NULL) {
+		fprintf(e->out, "\tsp -= 1;\n");
+		*e->stack_count += 1;
+	}
+	return true;
+}
+
+static bool transpile_instruction(CEmitter * e, size_t ip, Instruction instruction)
+{
+	switch (instruction.token.type) {
+	case TOK_PUSH:
+		// INT32_MIN has no literal of its own
+		push_item(e, ip, nob_temp_sprintf("(int32_t)%lldll", (long long)instruction.value.i32));
+		return true;
+	// Unsigned arithmetic wraps around like the interpreter's without signed overflow for the optimizer to exploit
+	case TOK_PLUS:
+		return binary(e, ip, instruction, "(int32_t)((uint32_t)%s + (uint32_t)%s)");
+	case TOK_MINUS:
+		return binary(e, ip, instruction, "(int32_t)((uint32_t)%s - (uint32_t)%s)");
+	case TOK_MULTIPLY:
+		return binary(e, ip, instruction, "(int32_t)((uint32_t)%s * (uint32_t)%s)");
+	case TOK_DIVIDE:
+		return binary(e, ip, instruction, "divide(%s, %s)");
+	case TOK_EQUAL:
+		return binary(e, ip, instruction, "%s == %s");
+	case TOK_GT:
+		return binary(e, ip, instruction, "%s > %s");
+	case TOK_LT:
+		return binary(e, ip, instruction, "%s < %s");
+	case TOK_DUMP:
+		if (!pop_items(e, instruction, 1)) return false;
+		fprintf(e->out, "\tdump(%s);\n", item(e, ip, 1));
+		if (e->depths == NULL) fprintf(e->out, "\tsp -= 1;\n");
+		return true;
+	case TOK_DUP:
+		if (!pop_items(e, instruction, 1)) return false;
+		if (e->depths == NULL) *e->stack_count += 1;
+		push_item(e, ip, item(e, ip, 1));
+		return true;
+	case TOK_IF:
+	case TOK_DO:
+		if (!pop_items(e, instruction, 1)) return false;
+		if (e->depths == NULL) fprintf(e->out, "\tsp -= 1;\n");
+		fprintf(e->out, "\tif (%s == 0) goto L%d;\n", e->depths ? item(e, ip, 1) : "stack[sp]", instruction.value.i32);
+		return true;
+	case TOK_ELSE:
+		fprintf(e->out, "\tgoto L%d;\n", instruction.value.i32);
+		return true;
+	case TOK_END:
+		if ((size_t)instruction.value.i32 < ip + 1) fprintf(e->out, "\tgoto L%d;\n", instruction.value.i32);
+		return true;
+	case TOK_WHILE:
+		return true;
+	default:
+		assert(false && "Unreachable");
+		return false;
+	}
+}
+
+bool transpileToC(const InstructionArray * instructions, FILE * out, bool lines)
+{
+	StackEffects effects = {0};
+	bool verified = verifyStackEffects(instructions, &effects, false);
+	size_t stack_count = 0;
+	CEmitter e = {0};
+	e.out = out;
+	e.depths = verified ? effects.depths : NULL;
+	e.stack_count = &stack_count;
+
+	// Labels only go where jumps land, the optimizer doesn't need to see the others
+	bool * targets = calloc(instructions->count + 1, sizeof(*targets));
+	assert(targets != NULL && "Buy more RAM lol");
+	for (size_t i = 0; i < instructions->count; i++) {
+		switch (instructions->items[i].token.type) {
+		case TOK_IF:
+		case TOK_DO:
+		case TOK_ELSE:
+		case TOK_END:
+			targets[instructions->items[i].value.i32] = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	fprintf(out, "#define OUTPUT_CAPACITY %d\n", OUTPUT_DEFAULT_CAPACITY);
+	fprintf(out, "#define OUTPUT_MAX_LINE %d\n", OUTPUT_MAX_LINE);
+	fputs(runtime, out);
+	if (!verified) {
+		fputs(dynamicStack, out);
+		print_underflow(out, instructions->count > 0 ? instructions->items[0].token.filePath : "");
+	}
+	fprintf(out, "int main(void)\n{\n");
+	if (verified) {
+		for (size_t i = 0; i < effects.maxDepth; i++) {
+			fprintf(out, "\tint32_t s%zu;\n", i);
+		}
+	} else {
+		fprintf(out, "\tsize_t sp = 0;\n");
+	}
+
+	bool result = true;
+	for (size_t ip = 0; result && ip <= instructions->count; ip++) {
+		if (targets[ip]) fprintf(out, "L%zu: ;\n", ip);
+		if (ip == instructions->count) break;
+		// Nothing reaches it, and it has no depth to name its slots by
+		if (verified && effects.depths[ip] == UNKNOWN_DEPTH) continue;
+		Token token = instructions->items[ip].token;
+		if (lines) {
+			fprintf(out, "#line %zu ", token.lineNum);
+			print_string_literal(out, token.filePath);
+			fputc('\n', out);
+		}
+		result = transpile_instruction(&e, ip, instructions->items[ip]);
+		nob_temp_reset();
+	}
+	fprintf(out, "\tflush();\n\treturn 0;\n}\n");
+	free(targets);
+	freeStackEffects(&effects);
+	return result;
+}
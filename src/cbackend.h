@@ -0,0 +1,13 @@
+#ifndef _CBACKEND_H
+#define _CBACKEND_H
+
+#include "types.h"
+#include <stdio.h>
+
+// Writes the program as a C translation unit with a main that runs it. When the verifier knows the depth
+// at every instruction each stack slot becomes a local and the optimizer gets to see all the data flow,
+// otherwise the items live in an array that grows as needed. With lines every statement gets a #line
+// for the instruction it comes from. Returns false after reporting an underflow.
+bool transpileToC(const InstructionArray * instructions, FILE * out, bool lines);
+
+#endif // _CBACKEND_H
@@ -1,8 +1,19 @@
 #include "compiler.h"
 
 #include "error.h"
+#include "elf64.h"
+#include "output.h"
+#include "verifier.h"
+#include "linter.h"
+#include "cache.h"
+#include "cbackend.h"
+#include "dwarf.h"
 #include "nob.h"
 
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
 static size_t strip_ext(char *fname)
 {
     char *end = fname + strlen(fname);
@@ -18,161 +29,618 @@ static size_t strip_ext(char *fname)
     return end - fname + 1;
 }
 
-static void compileInstruction(size_t * stack_count, size_t ip, Instruction instruction, FILE * out)
+// The top of the stack is kept in registers and constants that haven't been written anywhere yet,
+// everything below them lives on the native stack. Only callee saved registers are handed out so
+// values survive the call to dump, rax, rcx, rdx and rdi stay free as scratch.
+static const Register pool[] = { RBX, R12, R13, R14, R15 };
+
+// Deepest the virtual part of the stack gets before its bottom is spilled, pushing a long run of constants shouldn't grow it forever
+#define VIRTUAL_STACK_MAX 16
+// How many of the top items stay in registers across a jump when the depth there is known
+#define MERGE_REGISTERS 3
+
+typedef enum {
+	VIRTUAL_REGISTER,
+	VIRTUAL_CONSTANT,
+	VIRTUAL_SUM, // reg + index + constant that hasn't been computed yet, a run of additions ends up as a single lea
+} VirtualKind;
+
+typedef struct {
+	VirtualKind kind;
+	Register reg;
+	Register index;
+	bool hasIndex;
+	int32_t constant;
+} VirtualValue;
+
+typedef struct {
+	Assembler * a;
+	size_t * stack_count;
+	const size_t * depths;
+	size_t firstLabel;
+	size_t dump;
+	VirtualValue items[VIRTUAL_STACK_MAX]; // items[count - 1] is the top of the stack
+	size_t count;
+	size_t uses[16]; // How many values read each register, dup hands out the same register twice
+	bool reachable;
+	const InstructionArray * instructions;
+	const bool * targets; // Indexed from first, where jumps land
+	size_t first;
+	size_t stop;
+	bool fused; // The instruction just compiled took care of the next one too
+	bool underflow;
+} CodeGen;
+
+static void require_items(CodeGen * g, size_t count, Instruction instruction)
+{
+	if (g->stack_count == NULL) return;
+	if (*g->stack_count < count) {
+		reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
+		// The rest still gets compiled so the caller can carry on with other files, but nobody runs it
+		g->underflow = true;
+		g->stack_count = NULL;
+		return;
+	}
+	*g->stack_count -= count;
+}
+
+static void push_items(CodeGen * g, size_t count)
+{
+	if (g->stack_count) *g->stack_count += count;
+}
+
+// Minos numbers are 32 bit and wrap around, this is what the interpreter's int32_t arithmetic ends up with
+static int32_t wrap(int64_t value)
+{
+	return (int32_t)(uint32_t)value;
+}
+
+static VirtualValue register_value(Register reg)
+{
+	return (VirtualValue) { .kind = VIRTUAL_REGISTER, .reg = reg };
+}
+
+static VirtualValue constant_value(int32_t constant)
+{
+	return (VirtualValue) { .kind = VIRTUAL_CONSTANT, .constant = constant };
+}
+
+static bool reads(VirtualValue v, Register reg)
+{
+	if (v.kind == VIRTUAL_CONSTANT) return false;
+	return v.reg == reg || (v.kind == VIRTUAL_SUM && v.hasIndex && v.index == reg);
+}
+
+static void retain(CodeGen * g, VirtualValue v)
+{
+	if (v.kind == VIRTUAL_CONSTANT) return;
+	g->uses[v.reg] += 1;
+	if (v.kind == VIRTUAL_SUM && v.hasIndex) g->uses[v.index] += 1;
+}
+
+static void release(CodeGen * g, VirtualValue v)
+{
+	if (v.kind == VIRTUAL_CONSTANT) return;
+	g->uses[v.reg] -= 1;
+	if (v.kind == VIRTUAL_SUM && v.hasIndex) g->uses[v.index] -= 1;
+}
+
+// The low 32 bits of the 64 bit address are the wrapped sum, lea into a 32 bit register keeps just those
+static Operand sum_address(VirtualValue v)
+{
+	return v.hasIndex ? memIndex(8, v.reg, v.index, 1, v.constant) : mem(8, v.reg, v.constant);
+}
+
+// Computes v sign extended into reg, which may be one of the registers v reads
+static void load(CodeGen * g, Register reg, VirtualValue v)
+{
+	switch (v.kind) {
+	case VIRTUAL_REGISTER:
+		if (v.reg != reg) asmOp2(g->a, MN_MOV, r64(reg), r64(v.reg));
+		break;
+	case VIRTUAL_CONSTANT:
+		asmOp2(g->a, MN_MOV, r64(reg), imm(v.constant));
+		break;
+	case VIRTUAL_SUM:
+		asmOp2(g->a, MN_LEA, r32(reg), sum_address(v));
+		asmOp2(g->a, MN_MOVSXD, r64(reg), r32(reg));
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+}
+
+// Writes the bottom virtual item out to the native stack
+static void spill_bottom(CodeGen * g)
+{
+	assert(g->count > 0);
+	VirtualValue v = g->items[0];
+	if (v.kind == VIRTUAL_SUM) {
+		load(g, RCX, v);
+		asmOp1(g->a, MN_PUSH, r64(RCX));
+	} else {
+		asmOp1(g->a, MN_PUSH, v.kind == VIRTUAL_REGISTER ? r64(v.reg) : imm(v.constant));
+	}
+	release(g, v);
+	g->count -= 1;
+	memmove(g->items, g->items + 1, g->count * sizeof(*g->items));
+}
+
+// Everything goes to the native stack before a jump and at every place a jump lands, so all paths agree on where the items are
+static void flush(CodeGen * g)
+{
+	while (g->count > 0) spill_bottom(g);
+}
+
+static void count_uses(CodeGen * g)
+{
+	memset(g->uses, 0, sizeof(g->uses));
+	for (size_t i = 0; i < g->count; i++) {
+		retain(g, g->items[i]);
+	}
+}
+
+// Where every path agrees the items are when it reaches a place jumps land at with depth items on the stack.
+// The item depth - 1 from the bottom lives in pool[(depth - 1) % pool size] and so on down to MERGE_REGISTERS
+// items, all below are on the native stack. Tying registers to depths means a loop whose body just replaces
+// its counter keeps finding it in the same register.
+static size_t merge_registers(CodeGen * g, size_t depth)
+{
+	if (g->depths == NULL || depth == UNKNOWN_DEPTH) return 0;
+	return depth < MERGE_REGISTERS ? depth : MERGE_REGISTERS;
+}
+
+static Register merge_register(size_t depth, size_t i, size_t count)
+{
+	return pool[(depth - count + i) % NOB_ARRAY_LEN(pool)];
+}
+
+static void assume_merge_state(CodeGen * g, size_t depth)
+{
+	g->count = merge_registers(g, depth);
+	for (size_t i = 0; i < g->count; i++) {
+		g->items[i] = register_value(merge_register(depth, i, g->count));
+	}
+	count_uses(g);
+}
+
+static Register allocate(CodeGen * g)
+{
+	for (;;) {
+		for (size_t i = 0; i < NOB_ARRAY_LEN(pool); i++) {
+			if (g->uses[pool[i]] == 0) {
+				g->uses[pool[i]] = 1;
+				return pool[i];
+			}
+		}
+		spill_bottom(g);
+	}
+}
+
+// v has to be retained already, the stack takes over that use
+static void push_value(CodeGen * g, VirtualValue v)
+{
+	if (g->count == VIRTUAL_STACK_MAX) spill_bottom(g);
+	g->items[g->count++] = v;
+}
+
+static void push_register(CodeGen * g, Register reg)
+{
+	push_value(g, register_value(reg));
+}
+
+// Brings the top count items into the virtual part, popping the ones that were spilled into registers
+static void ensure(CodeGen * g, size_t count)
+{
+	while (g->count < count) {
+		Register reg = allocate(g);
+		asmOp1(g->a, MN_POP, r64(reg));
+		memmove(g->items + 1, g->items, g->count * sizeof(*g->items));
+		g->items[0] = register_value(reg);
+		g->count += 1;
+	}
+}
+
+// Computes a pending sum so the value sits in a register or is a constant
+static VirtualValue materialize(CodeGen * g, VirtualValue v)
+{
+	if (v.kind != VIRTUAL_SUM) return v;
+	release(g, v);
+	Register reg = allocate(g);
+	load(g, reg, v);
+	return register_value(reg);
+}
+
+// Moves the items into the registers of the merge state, rcx breaks up cycles like two items that swap registers.
+// rax is left alone, conditional jumps keep their condition there.
+static void enter_merge_state(CodeGen * g, size_t depth)
+{
+	size_t count = merge_registers(g, depth);
+	while (g->count > count) spill_bottom(g);
+	ensure(g, count);
+	// Pending sums are computed first so every item reads at most one register
+	for (size_t i = 0; i < count; i++) {
+		g->items[i] = materialize(g, g->items[i]);
+	}
+
+	bool pending[MERGE_REGISTERS];
+	for (size_t i = 0; i < count; i++) {
+		VirtualValue v = g->items[i];
+		pending[i] = v.kind != VIRTUAL_REGISTER || v.reg != merge_register(depth, i, count);
+	}
+	for (;;) {
+		bool progress = false;
+		bool left = false;
+		for (size_t i = 0; i < count; i++) {
+			if (!pending[i]) continue;
+			left = true;
+			Register dst = merge_register(depth, i, count);
+			bool blocked = false;
+			for (size_t j = 0; j < count; j++) {
+				if (j != i && pending[j] && reads(g->items[j], dst)) blocked = true;
+			}
+			if (blocked) continue;
+			load(g, dst, g->items[i]);
+			g->items[i] = register_value(dst);
+			pending[i] = false;
+			progress = true;
+		}
+		if (!left) break;
+		if (progress) continue;
+		// Every pending item waits on another one, so some of them form a cycle. Moving a register one of
+		// them wants aside into rcx lets that one go ahead, dup can leave several items reading it.
+		Register moved = RCX;
+		for (size_t i = 0; i < count && moved == RCX; i++) {
+			if (!pending[i]) continue;
+			for (size_t j = 0; j < count; j++) {
+				if (pending[j] && reads(g->items[j], merge_register(depth, i, count))) moved = merge_register(depth, i, count);
+			}
+		}
+		assert(moved != RCX);
+		asmOp2(g->a, MN_MOV, r64(RCX), r64(moved));
+		for (size_t j = 0; j < count; j++) {
+			if (pending[j] && reads(g->items[j], moved)) g->items[j].reg = RCX;
+		}
+	}
+	count_uses(g);
+}
+
+static VirtualValue pop_value(CodeGen * g)
+{
+	ensure(g, 1);
+	return g->items[--g->count];
+}
+
+// A register holding v that the caller is free to overwrite, v's own register when nothing else reads it
+static Register result_register(CodeGen * g, VirtualValue v)
+{
+	v = materialize(g, v);
+	if (v.kind == VIRTUAL_REGISTER && g->uses[v.reg] == 1) return v.reg;
+	release(g, v);
+	Register reg = allocate(g);
+	load(g, reg, v);
+	return reg;
+}
+
+static Operand operand32(VirtualValue v)
+{
+	return v.kind == VIRTUAL_REGISTER ? r32(v.reg) : imm(v.constant);
+}
+
+// Additions are only recorded, constants gather in the displacement and two registers become base and index
+static VirtualValue add_values(CodeGen * g, VirtualValue lhs, VirtualValue rhs)
+{
+	if (lhs.kind == VIRTUAL_CONSTANT) {
+		VirtualValue swap = lhs;
+		lhs = rhs;
+		rhs = swap;
+	}
+	if (rhs.kind == VIRTUAL_CONSTANT) {
+		if (lhs.kind == VIRTUAL_CONSTANT) return constant_value(wrap((int64_t)lhs.constant + rhs.constant));
+		lhs.constant = lhs.kind == VIRTUAL_REGISTER ? rhs.constant : wrap((int64_t)lhs.constant + rhs.constant);
+		lhs.kind = VIRTUAL_SUM;
+		return lhs;
+	}
+	if (lhs.kind == VIRTUAL_SUM && lhs.hasIndex) lhs = materialize(g, lhs);
+	if (rhs.kind == VIRTUAL_SUM && rhs.hasIndex) rhs = materialize(g, rhs);
+	if (lhs.kind == VIRTUAL_SUM && rhs.kind == VIRTUAL_SUM) rhs = materialize(g, rhs);
+	if (rhs.kind == VIRTUAL_SUM) {
+		VirtualValue swap = lhs;
+		lhs = rhs;
+		rhs = swap;
+	}
+	VirtualValue sum = { .kind = VIRTUAL_SUM, .reg = lhs.reg, .index = rhs.reg, .hasIndex = true };
+	sum.constant = lhs.kind == VIRTUAL_SUM ? lhs.constant : 0;
+	return sum;
+}
+
+static void compile_plus(CodeGen * g, Instruction instruction)
+{
+	require_items(g, 2, instruction);
+	ensure(g, 2);
+	VirtualValue rhs = pop_value(g);
+	VirtualValue lhs = pop_value(g);
+	VirtualValue sum = add_values(g, lhs, rhs);
+	push_value(g, sum);
+	push_items(g, 1);
+}
+
+static void compile_minus(CodeGen * g, Instruction instruction)
+{
+	require_items(g, 2, instruction);
+	ensure(g, 2);
+	VirtualValue rhs = pop_value(g);
+	VirtualValue lhs = pop_value(g);
+	if (rhs.kind == VIRTUAL_CONSTANT) {
+		push_value(g, add_values(g, lhs, constant_value(wrap(-(int64_t)rhs.constant))));
+	} else {
+		rhs = materialize(g, rhs);
+		Register dst = result_register(g, lhs);
+		asmOp2(g->a, MN_SUB, r32(dst), r32(rhs.reg));
+		asmOp2(g->a, MN_MOVSXD, r64(dst), r32(dst));
+		release(g, rhs);
+		push_register(g, dst);
+	}
+	push_items(g, 1);
+}
+
+static void compile_multiply(CodeGen * g, Instruction instruction)
+{
+	require_items(g, 2, instruction);
+	ensure(g, 2);
+	VirtualValue rhs = pop_value(g);
+	VirtualValue lhs = pop_value(g);
+	if (lhs.kind == VIRTUAL_CONSTANT) {
+		VirtualValue swap = lhs;
+		lhs = rhs;
+		rhs = swap;
+	}
+	if (rhs.kind == VIRTUAL_CONSTANT) {
+		if (lhs.kind == VIRTUAL_CONSTANT) {
+			push_value(g, constant_value(wrap((int64_t)lhs.constant * rhs.constant)));
+		} else if (rhs.constant == 0) {
+			release(g, lhs);
+			push_value(g, constant_value(0));
+		} else if (rhs.constant == 1) {
+			push_value(g, lhs);
+		} else {
+			// The three operand imul writes a fresh register straight from the source, no copy needed
+			lhs = materialize(g, lhs);
+			Register dst = lhs.reg;
+			if (g->uses[dst] != 1) {
+				release(g, lhs);
+				dst = allocate(g);
+			}
+			asmOp3(g->a, MN_IMUL, r32(dst), r32(lhs.reg), imm(rhs.constant));
+			asmOp2(g->a, MN_MOVSXD, r64(dst), r32(dst));
+			push_register(g, dst);
+		}
+	} else {
+		rhs = materialize(g, rhs);
+		Register dst = result_register(g, lhs);
+		asmOp2(g->a, MN_IMUL, r32(dst), r32(rhs.reg));
+		asmOp2(g->a, MN_MOVSXD, r64(dst), r32(dst));
+		release(g, rhs);
+		push_register(g, dst);
+	}
+	push_items(g, 1);
+}
+
+static void compile_divide(CodeGen * g, Instruction instruction)
+{
+	require_items(g, 2, instruction);
+	ensure(g, 2);
+	VirtualValue rhs = pop_value(g);
+	VirtualValue lhs = pop_value(g);
+	// Dividing by zero or INT32_MIN by -1 is left to fault at runtime the way the interpreter does
+	if (lhs.kind == VIRTUAL_CONSTANT && rhs.kind == VIRTUAL_CONSTANT && rhs.constant != 0 && !(lhs.constant == INT32_MIN && rhs.constant == -1)) {
+		push_value(g, constant_value(lhs.constant / rhs.constant));
+		push_items(g, 1);
+		return;
+	}
+	if (rhs.kind == VIRTUAL_CONSTANT && rhs.constant == 1) {
+		push_value(g, lhs);
+		push_items(g, 1);
+		return;
+	}
+	rhs = materialize(g, rhs);
+	if (lhs.kind == VIRTUAL_SUM) {
+		asmOp2(g->a, MN_LEA, r32(RAX), sum_address(lhs));
+	} else {
+		asmOp2(g->a, MN_MOV, r32(RAX), operand32(lhs));
+	}
+	asmOp0(g->a, MN_CDQ);
+	if (rhs.kind == VIRTUAL_CONSTANT) {
+		asmOp2(g->a, MN_MOV, r32(RCX), imm(rhs.constant));
+		asmOp1(g->a, MN_IDIV, r32(RCX));
+	} else {
+		asmOp1(g->a, MN_IDIV, r32(rhs.reg));
+	}
+	release(g, rhs);
+	release(g, lhs);
+	Register dst = allocate(g);
+	asmOp2(g->a, MN_MOVSXD, r64(dst), r32(RAX));
+	push_register(g, dst);
+	push_items(g, 1);
+}
+
+static size_t depth_at(CodeGen * g, size_t ip)
+{
+	return g->depths ? g->depths[ip] : UNKNOWN_DEPTH;
+}
+
+static bool compare(int32_t lhs, int32_t rhs, Condition cc)
+{
+	switch (cc) {
+	case CC_E: return lhs == rhs;
+	case CC_G: return lhs > rhs;
+	case CC_L: return lhs < rhs;
+	default:
+		assert(false && "Unreachable");
+		return false;
+	}
+}
+
+// The condition that holds whenever cc doesn't
+static Condition negated(Condition cc)
+{
+	switch (cc) {
+	case CC_E: return CC_NE;
+	case CC_G: return CC_LE;
+	case CC_L: return CC_GE;
+	default:
+		assert(false && "Unreachable");
+		return cc;
+	}
+}
+
+// Whether the instruction after ip is an if or do that only ever sees the result of the one at ip
+static bool feeds_branch(CodeGen * g, size_t ip)
+{
+	size_t next = ip + 1;
+	if (next >= g->stop || g->targets[next - g->first]) return false;
+	TokenType type = g->instructions->items[next].token.type;
+	return type == TOK_IF || type == TOK_DO;
+}
+
+// The same comparison with its operands swapped
+static Condition swapped(Condition cc)
+{
+	switch (cc) {
+	case CC_G: return CC_L;
+	case CC_L: return CC_G;
+	default: return cc;
+	}
+}
+
+static void compile_comparison(CodeGen * g, size_t ip, Instruction instruction, Condition cc)
+{
+	require_items(g, 2, instruction);
+	ensure(g, 2);
+	VirtualValue rhs = pop_value(g);
+	VirtualValue lhs = pop_value(g);
+	if (lhs.kind == VIRTUAL_CONSTANT && rhs.kind == VIRTUAL_CONSTANT) {
+		push_value(g, constant_value(compare(lhs.constant, rhs.constant, cc)));
+		push_items(g, 1);
+		return;
+	}
+	if (lhs.kind == VIRTUAL_CONSTANT) {
+		VirtualValue swap = lhs;
+		lhs = rhs;
+		rhs = swap;
+		cc = swapped(cc);
+	}
+	lhs = materialize(g, lhs);
+	rhs = materialize(g, rhs);
+	// Both are sign extended so comparing all 64 bits orders them like the 32 bit numbers
+	asmOp2(g->a, MN_CMP, r64(lhs.reg), rhs.kind == VIRTUAL_REGISTER ? r64(rhs.reg) : imm(rhs.constant));
+	release(g, rhs);
+	release(g, lhs);
+	if (feeds_branch(g, ip)) {
+		// Jump on the flags straight away, getting to the merge state only takes moves, leas and pushes which leave them alone
+		size_t target = g->instructions->items[ip + 1].value.i32;
+		enter_merge_state(g, depth_at(g, target));
+		asmJcc(g->a, negated(cc), g->firstLabel + target);
+		g->fused = true;
+		return;
+	}
+	Register dst = allocate(g);
+	asmSetcc(g->a, cc, r8(dst));
+	asmOp2(g->a, MN_MOVZX, r32(dst), r8(dst));
+	push_register(g, dst);
+	push_items(g, 1);
+}
+
+static void compile_jump(CodeGen * g, size_t target)
+{
+	enter_merge_state(g, depth_at(g, target));
+	asmJmp(g->a, g->firstLabel + target);
+	g->reachable = false;
+}
+
+static void compile_branch_if_zero(CodeGen * g, Instruction instruction)
+{
+	require_items(g, 1, instruction);
+	VirtualValue condition = pop_value(g);
+	size_t target = instruction.value.i32;
+	if (condition.kind == VIRTUAL_CONSTANT) {
+		if (condition.constant == 0) compile_jump(g, target);
+		return;
+	}
+	load(g, RAX, condition);
+	release(g, condition);
+	// Both ways lead to a place with the same depth, so the merge state also suits the code that falls through
+	enter_merge_state(g, depth_at(g, target));
+	asmOp2(g->a, MN_TEST, r64(RAX), r64(RAX));
+	asmJcc(g->a, CC_Z, g->firstLabel + target);
+}
+
+static void compile_instruction(CodeGen * g, size_t ip, Instruction instruction)
 {
-	fprintf(out, ".INSTRUCTION_%zu:\n", ip);
 	switch (instruction.token.type) {
 	case TOK_PUSH:
 		switch (instruction.value.type) {
 		case I32:
-			fprintf(out, "    push    %d\n", instruction.value.i32);
+			push_value(g, constant_value(instruction.value.i32));
 			break;
 		default:
 			assert(false && "Unreachable");
 		}
-		*stack_count += 1;
+		push_items(g, 1);
 		break;
 	case TOK_PLUS:
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    add     rax, rbx\n");
-		fprintf(out, "    push    rax\n");
-		*stack_count += 1;
+		compile_plus(g, instruction);
 		break;
 	case TOK_MINUS:
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    sub     rax, rbx\n");
-		fprintf(out, "    push    rax\n");
-		*stack_count += 1;
+		compile_minus(g, instruction);
 		break;
 	case TOK_MULTIPLY:
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    mul     rbx\n");
-		fprintf(out, "    push    rax\n");
-		*stack_count += 1;
+		compile_multiply(g, instruction);
 		break;
 	case TOK_DIVIDE:
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    div     rbx\n");
-		fprintf(out, "    push    rax\n");
-		*stack_count += 1;
-		break;
-	case TOK_DUMP:
-		if (*stack_count < 1) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rdi\n");
-		*stack_count -= 1;
-		fprintf(out, "    call    dump\n");
+		compile_divide(g, instruction);
+		break;
+	case TOK_DUMP: {
+		require_items(g, 1, instruction);
+		VirtualValue v = pop_value(g);
+		load(g, RDI, v);
+		release(g, v);
+		asmCall(g->a, g->dump);
 		break;
+	}
 	case TOK_EQUAL:
-		fprintf(out, "    mov     rcx, 0\n");
-		fprintf(out, "    mov     rdx, 1\n");
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    cmp     rax, rbx\n");
-		fprintf(out, "    cmove   rcx, rdx\n");
-		fprintf(out, "    push    rcx\n");
-		*stack_count += 1;
+		compile_comparison(g, ip, instruction, CC_E);
 		break;
 	case TOK_IF:
-		if (*stack_count < 1) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 1;
-		fprintf(out, "    test    rax, rax\n");
-		fprintf(out, "    jz      .INSTRUCTION_%u\n", instruction.value.i32);
+	case TOK_DO:
+		compile_branch_if_zero(g, instruction);
 		break;
 	case TOK_ELSE:
-		fprintf(out, "    jmp     .INSTRUCTION_%u\n", instruction.value.i32);
+		compile_jump(g, instruction.value.i32);
 		break;
 	case TOK_END:
-		if (instruction.value.i32 && (size_t)instruction.value.i32 < ip + 1)
-			fprintf(out, "    jmp     .INSTRUCTION_%u\n", instruction.value.i32);
+		if ((size_t)instruction.value.i32 < ip + 1) compile_jump(g, instruction.value.i32);
 		break;
-	case TOK_DUP:
-		if (*stack_count < 1) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 1;
-		fprintf(out, "    push    rax\n");
-		fprintf(out, "    push    rax\n");
-		*stack_count += 2;
+	case TOK_DUP: {
+		require_items(g, 1, instruction);
+		ensure(g, 1);
+		// The copy shares the original's register, whoever changes it first makes its own. A pending sum
+		// is computed here, otherwise both copies would compute it again.
+		VirtualValue top = materialize(g, g->items[g->count - 1]);
+		g->items[g->count - 1] = top;
+		retain(g, top);
+		push_value(g, top);
+		push_items(g, 2);
 		break;
+	}
 	case TOK_GT:
-		fprintf(out, "    mov     rcx, 0\n");
-		fprintf(out, "    mov     rdx, 1\n");
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    cmp     rax, rbx\n");
-		fprintf(out, "    cmovg   rcx, rdx\n");
-		fprintf(out, "    push    rcx\n");
-		*stack_count += 1;
+		compile_comparison(g, ip, instruction, CC_G);
 		break;
 	case TOK_WHILE:
 		break;
-	case TOK_DO:
-		if (*stack_count < 1) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 1;
-		fprintf(out, "    test    rax, rax\n");
-		fprintf(out, "    jz      .INSTRUCTION_%u\n", instruction.value.i32);
-		break;
 	case TOK_LT:
-		fprintf(out, "    mov     rcx, 0\n");
-		fprintf(out, "    mov     rdx, 1\n");
-		if (*stack_count < 2) {
-			reportError(instruction.token.filePath, instruction.token.lineNum, instruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
-			exit(1);
-		}
-		fprintf(out, "    pop     rbx\n");
-		fprintf(out, "    pop     rax\n");
-		*stack_count -= 2;
-		fprintf(out, "    cmp     rax, rbx\n");
-		fprintf(out, "    cmovl   rcx, rdx\n");
-		fprintf(out, "    push    rcx\n");
-		*stack_count += 1;
+		compile_comparison(g, ip, instruction, CC_L);
 		break;
 	default:
 		assert(false && "Unreachable");
@@ -180,75 +648,875 @@ static void compileInstruction(size_t * stack_count, size_t ip, Instruction inst
 	}
 }
 
-static void write_dump_function(FILE * out)
-{
-	fprintf(out, "dump:\n");
-	fprintf(out, "    mov     r9, -3689348814741910323\n");
-	fprintf(out, "    sub     rsp, 40\n");
-	fprintf(out, "    mov     BYTE [rsp+31], 10\n");
-	fprintf(out, "    lea     rcx, [rsp+30]\n");
-	fprintf(out, ".L2:\n");
-	fprintf(out, "    mov     rax, rdi\n");
-	fprintf(out, "    lea     r8, [rsp+32]\n");
-	fprintf(out, "    mul     r9\n");
-	fprintf(out, "    mov     rax, rdi\n");
-	fprintf(out, "    sub     r8, rcx\n");
-	fprintf(out, "    shr     rdx, 3\n");
-	fprintf(out, "    lea     rsi, [rdx+rdx*4]\n");
-	fprintf(out, "    add     rsi, rsi\n");
-	fprintf(out, "    sub     rax, rsi\n");
-	fprintf(out, "    add     eax, 48\n");
-	fprintf(out, "    mov     BYTE [rcx], al\n");
-	fprintf(out, "    mov     rax, rdi\n");
-	fprintf(out, "    mov     rdi, rdx\n");
-	fprintf(out, "    mov     rdx, rcx\n");
-	fprintf(out, "    sub     rcx, 1\n");
-	fprintf(out, "    cmp     rax, 9\n");
-	fprintf(out, "    ja      .L2\n");
-	fprintf(out, "    lea     rax, [rsp+32]\n");
-	fprintf(out, "    mov     edi, 1\n");
-	fprintf(out, "    sub     rdx, rax\n");
-	fprintf(out, "    xor     eax, eax\n");
-	fprintf(out, "    lea     rsi, [rsp+32+rdx]\n");
-	fprintf(out, "    mov     rdx, r8\n");
-	fprintf(out, "    mov     rax, 1\n");
-	fprintf(out, "    syscall\n");
-	fprintf(out, "    add     rsp, 40\n");
-	fprintf(out, "    ret\n");
-}
-
-void compileProgram(InstructionArray * instructions, const char * filePath)
-{
-	char outFilePath[32] = {0};
-	
-	memcpy(outFilePath, filePath, strlen(filePath));
-	strip_ext(outFilePath);
-	
-	FILE * out = fopen("tmp.asm", "w");
-	fprintf(out, "segment .text\n");
-	fprintf(out, "\n");
-	write_dump_function(out);
-	fprintf(out, "\n");
-	fprintf(out, "global _start\n");
-	fprintf(out, "_start:\n");
+static bool is_branch(TokenType type)
+{
+	return type == TOK_IF || type == TOK_DO || type == TOK_ELSE || type == TOK_END;
+}
+
+size_t findBasicBlocks(const InstructionArray * instructions, size_t * blockOf)
+{
+	// First mark where blocks start, every jump target and whatever follows a jump. The 'end' of an 'if'
+	// only goes on to the next instruction, so it doesn't end its block.
+	bool * leaders = calloc(instructions->count + 1, sizeof(*leaders));
+	assert(leaders != NULL && "Buy more RAM lol");
+	leaders[0] = true;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		Instruction instruction = instructions->items[ip];
+		if (!is_branch(instruction.token.type) || (size_t)instruction.value.i32 == ip + 1) continue;
+		leaders[instruction.value.i32] = true;
+		leaders[ip + 1] = true;
+	}
+	size_t count = 0;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		if (leaders[ip]) count += 1;
+		blockOf[ip] = count - 1;
+	}
+	free(leaders);
+	return count;
+}
+
+bool compileInstructions(Assembler * a, const InstructionArray * instructions, size_t first, size_t stop, size_t firstLabel, size_t dump, const size_t * depths, size_t * stack_count, const Instrumentation * instrument)
+{
+	// Mark where jumps land up front, those are the places the virtual stack has to be empty
+	bool * targets = calloc(stop - first + 1, sizeof(*targets));
+	assert(targets != NULL && "Buy more RAM lol");
+	for (size_t i = first; i < stop; i++) {
+		Instruction instruction = instructions->items[i];
+		switch (instruction.token.type) {
+		case TOK_IF:
+		case TOK_DO:
+		case TOK_ELSE:
+		case TOK_END:
+			if ((size_t)instruction.value.i32 >= first && (size_t)instruction.value.i32 <= stop) {
+				targets[instruction.value.i32 - first] = true;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	CodeGen g = {0};
+	g.a = a;
+	g.stack_count = stack_count;
+	g.depths = depths;
+	g.firstLabel = firstLabel;
+	g.dump = dump;
+	g.instructions = instructions;
+	g.targets = targets;
+	g.first = first;
+	g.stop = stop;
+	g.reachable = true;
+	for (size_t ip = first; ip <= stop; ip++) {
+		if (targets[ip - first]) {
+			if (g.reachable) enter_merge_state(&g, depth_at(&g, ip));
+			assume_merge_state(&g, depth_at(&g, ip));
+			g.reachable = true;
+		}
+		asmBind(a, firstLabel + ip);
+		if (g.fused) {
+			g.fused = false;
+		} else if (ip < stop) {
+			Token token = instructions->items[ip].token;
+			asmLine(a, token.filePath, token.lineNum, token.colNum);
+			// Blocks start where the flags are dead, and inc leaves the registers alone
+			if (instrument && (ip == 0 || instrument->blockOf[ip] != instrument->blockOf[ip - 1])) {
+				asmOp1(a, MN_INC, memLabelDisp(8, instrument->counters, instrument->blockOf[ip] * 8));
+			}
+			compile_instruction(&g, ip, instructions->items[ip]);
+		}
+	}
+	// Whatever comes next finds every item on the native stack
+	flush(&g);
+	free(targets);
+	return !g.underflow;
+}
+
+// The output of a compiled program collects in a buffer in .bss and goes out with one write once it's full and at exit,
+// the same as the interpreter's OutputBuffer. Labels of the runtime, the buffer and its fill are reserved by the caller.
+typedef struct {
+	size_t dump;   // Appends the int32 sign extended in rdi and a newline
+	size_t flush;  // Writes out the buffer
+	size_t buffer;
+	size_t filled;
+} OutputRuntime;
+
+static OutputRuntime new_output_runtime(Assembler * a)
+{
+	OutputRuntime rt = {0};
+	rt.dump = asmNewLabel(a, "dump");
+	rt.flush = asmNewLabel(a, "flush");
+	rt.buffer = asmNewLabel(a, "output_buffer");
+	rt.filled = asmNewLabel(a, "output_filled");
+	return rt;
+}
+
+static void compile_output_runtime(Assembler * a, OutputRuntime rt)
+{
+	size_t pairs = asmNewLabel(a, "digit_pairs");
+	size_t fits = asmNewLabel(a, ".fits");
+	size_t pair = asmNewLabel(a, ".pair");
+	size_t last = asmNewLabel(a, ".last");
+	size_t single = asmNewLabel(a, ".single");
+	size_t sign = asmNewLabel(a, ".sign");
+	size_t copy = asmNewLabel(a, ".copy");
+	size_t write = asmNewLabel(a, ".write");
+	size_t append = asmNewLabel(a, ".append");
+	size_t done = asmNewLabel(a, ".done");
+
+	asmBind(a, rt.dump);
+	asmOp2(a, MN_CMP, memLabel(8, rt.filled), imm(OUTPUT_DEFAULT_CAPACITY - OUTPUT_MAX_LINE));
+	asmJcc(a, CC_BE, fits);
+	asmOp1(a, MN_PUSH, r64(RDI));
+	asmCall(a, rt.flush);
+	asmOp1(a, MN_POP, r64(RDI));
+	asmBind(a, fits);
+	// The magnitude as unsigned, -INT32_MIN stays 0x80000000 which is just right
+	asmOp2(a, MN_MOV, r32(RAX), r32(RDI));
+	asmOp1(a, MN_NEG, r32(RAX));
+	asmCmov(a, CC_S, r32(RAX), r32(RDI));
+	// Digits go back to front into a scratch line on the stack ending at rsp + 24, two at a time from the table
+	asmOp2(a, MN_SUB, r64(RSP), imm(24));
+	asmOp2(a, MN_LEA, r64(RCX), mem(8, RSP, 23));
+	asmOp2(a, MN_MOV, mem(1, RCX, 0), imm('\n'));
+	asmOp2(a, MN_LEA, r64(R9), memLabel(8, pairs));
+	asmBind(a, pair);
+	asmOp2(a, MN_CMP, r32(RAX), imm(100));
+	asmJcc(a, CC_B, last);
+	// edx = eax / 100 by multiplying with 2^37 / 100 rounded up, exact for every uint32
+	asmOp2(a, MN_MOV, r32(RDX), r32(RAX));
+	asmOp3(a, MN_IMUL, r64(RDX), r64(RDX), imm(1374389535));
+	asmOp2(a, MN_SHR, r64(RDX), imm(37));
+	asmOp3(a, MN_IMUL, r32(R10), r32(RDX), imm(100));
+	asmOp2(a, MN_SUB, r32(RAX), r32(R10));
+	asmOp2(a, MN_MOV, r8(R11), memIndex(1, R9, RAX, 2, 0));
+	asmOp2(a, MN_MOV, mem(1, RCX, -2), r8(R11));
+	asmOp2(a, MN_MOV, r8(R11), memIndex(1, R9, RAX, 2, 1));
+	asmOp2(a, MN_MOV, mem(1, RCX, -1), r8(R11));
+	asmOp2(a, MN_SUB, r64(RCX), imm(2));
+	asmOp2(a, MN_MOV, r32(RAX), r32(RDX));
+	asmJmp(a, pair);
+	asmBind(a, last);
+	asmOp2(a, MN_CMP, r32(RAX), imm(10));
+	asmJcc(a, CC_B, single);
+	asmOp2(a, MN_MOV, r8(R11), memIndex(1, R9, RAX, 2, 0));
+	asmOp2(a, MN_MOV, mem(1, RCX, -2), r8(R11));
+	asmOp2(a, MN_MOV, r8(R11), memIndex(1, R9, RAX, 2, 1));
+	asmOp2(a, MN_MOV, mem(1, RCX, -1), r8(R11));
+	asmOp2(a, MN_SUB, r64(RCX), imm(2));
+	asmJmp(a, sign);
+	asmBind(a, single);
+	asmOp2(a, MN_ADD, r32(RAX), imm('0'));
+	asmOp2(a, MN_MOV, mem(1, RCX, -1), r8(RAX));
+	asmOp2(a, MN_SUB, r64(RCX), imm(1));
+	asmBind(a, sign);
+	asmOp2(a, MN_TEST, r32(RDI), r32(RDI));
+	asmJcc(a, CC_NS, copy);
+	asmOp2(a, MN_MOV, mem(1, RCX, -1), imm('-'));
+	asmOp2(a, MN_SUB, r64(RCX), imm(1));
+	// Appends the line from rcx to rsp + 24 to the buffer
+	asmBind(a, copy);
+	asmOp2(a, MN_MOV, r64(RAX), memLabel(8, rt.filled));
+	asmOp2(a, MN_LEA, r64(RDX), memLabel(8, rt.buffer));
+	asmOp2(a, MN_LEA, r64(R8), mem(8, RSP, 24));
+	asmBind(a, append);
+	asmOp2(a, MN_MOV, r8(R11), mem(1, RCX, 0));
+	asmOp2(a, MN_MOV, memIndex(1, RDX, RAX, 1, 0), r8(R11));
+	asmOp1(a, MN_INC, r64(RCX));
+	asmOp1(a, MN_INC, r64(RAX));
+	asmOp2(a, MN_CMP, r64(RCX), r64(R8));
+	asmJcc(a, CC_B, append);
+	asmOp2(a, MN_MOV, memLabel(8, rt.filled), r64(RAX));
+	asmOp2(a, MN_ADD, r64(RSP), imm(24));
+	asmOp0(a, MN_RET);
+
+	// Gives up on the first failed write, a program with nowhere to write to just carries on
+	asmBind(a, rt.flush);
+	asmOp2(a, MN_MOV, r64(RDX), memLabel(8, rt.filled));
+	asmOp2(a, MN_LEA, r64(RSI), memLabel(8, rt.buffer));
+	asmBind(a, write);
+	asmOp2(a, MN_TEST, r64(RDX), r64(RDX));
+	asmJcc(a, CC_Z, done);
+	asmOp2(a, MN_MOV, r32(RDI), imm(1));
+	asmOp2(a, MN_MOV, r32(RAX), imm(1));
+	asmOp0(a, MN_SYSCALL);
+	asmOp2(a, MN_TEST, r64(RAX), r64(RAX));
+	asmJcc(a, CC_LE, done);
+	asmOp2(a, MN_ADD, r64(RSI), r64(RAX));
+	asmOp2(a, MN_SUB, r64(RDX), r64(RAX));
+	asmJmp(a, write);
+	asmBind(a, done);
+	asmOp2(a, MN_MOV, memLabel(8, rt.filled), imm(0));
+	asmOp0(a, MN_RET);
+
+	uint8_t table[200];
+	for (size_t i = 0; i < 100; i++) {
+		table[2 * i] = '0' + i / 10;
+		table[2 * i + 1] = '0' + i % 10;
+	}
+	asmBind(a, pairs);
+	asmData(a, table, sizeof(table));
+}
+
+typedef struct {
+	size_t write;    // Writes the counters out, ignoring any errors like flush does
+	size_t counters;
+	size_t header;
+	size_t path;
+} CountsRuntime;
+
+static CountsRuntime new_counts_runtime(Assembler * a)
+{
+	CountsRuntime rt = {0};
+	rt.write = asmNewLabel(a, "write_counts");
+	rt.counters = asmNewLabel(a, "block_counts");
+	rt.header = asmNewLabel(a, "counts_header");
+	rt.path = asmNewLabel(a, "counts_path");
+	return rt;
+}
+
+// Where an instrumented executable writes its counters, relative to the directory it runs in
+static const char * counts_path(const char * filePath)
+{
+	char * name = strdup(nob_path_name(filePath));
+	assert(name != NULL && "Buy more RAM lol");
+	strip_ext(name);
+	const char * path = nob_temp_sprintf("%s.counts", name);
+	free(name);
+	return path;
+}
+
+// The header names the source by its absolute path so minos report finds it from anywhere
+static bool compile_counts_runtime(Assembler * a, CountsRuntime rt, const char * filePath, size_t blocks)
+{
+	char * source = realpath(filePath, NULL);
+	if (source == NULL) {
+		nob_log(NOB_ERROR, "Could not resolve %s: %s", filePath, strerror(errno));
+		return false;
+	}
+	const char * header = nob_temp_sprintf("%s %zu %s\n", COUNTS_MAGIC, blocks, source);
+	free(source);
+	const char * path = counts_path(filePath);
+
+	size_t writeAll = asmNewLabel(a, ".writeAll");
+	size_t written = asmNewLabel(a, ".written");
+	size_t done = asmNewLabel(a, ".done");
+	asmBind(a, rt.write);
+	asmOp2(a, MN_MOV, r32(RAX), imm(2));
+	asmOp2(a, MN_LEA, r64(RDI), memLabel(8, rt.path));
+	asmOp2(a, MN_MOV, r32(RSI), imm(O_WRONLY | O_CREAT | O_TRUNC));
+	asmOp2(a, MN_MOV, r32(RDX), imm(0644));
+	asmOp0(a, MN_SYSCALL);
+	asmOp2(a, MN_TEST, r64(RAX), r64(RAX));
+	asmJcc(a, CC_S, done);
+	asmOp2(a, MN_MOV, r64(R8), r64(RAX));
+	asmOp2(a, MN_LEA, r64(RSI), memLabel(8, rt.header));
+	asmOp2(a, MN_MOV, r32(RDX), imm(strlen(header)));
+	asmCall(a, writeAll);
+	asmOp2(a, MN_LEA, r64(RSI), memLabel(8, rt.counters));
+	asmOp2(a, MN_MOV, r32(RDX), imm(blocks * 8));
+	asmCall(a, writeAll);
+	asmOp2(a, MN_MOV, r64(RDI), r64(R8));
+	asmOp2(a, MN_MOV, r32(RAX), imm(3));
+	asmOp0(a, MN_SYSCALL);
+	asmBind(a, done);
+	asmOp0(a, MN_RET);
+	// rdx bytes from rsi to the file in r8
+	asmBind(a, writeAll);
+	asmOp2(a, MN_TEST, r64(RDX), r64(RDX));
+	asmJcc(a, CC_Z, written);
+	asmOp2(a, MN_MOV, r64(RDI), r64(R8));
+	asmOp2(a, MN_MOV, r32(RAX), imm(1));
+	asmOp0(a, MN_SYSCALL);
+	asmOp2(a, MN_TEST, r64(RAX), r64(RAX));
+	asmJcc(a, CC_LE, written);
+	asmOp2(a, MN_ADD, r64(RSI), r64(RAX));
+	asmOp2(a, MN_SUB, r64(RDX), r64(RAX));
+	asmJmp(a, writeAll);
+	asmBind(a, written);
+	asmOp0(a, MN_RET);
+
+	asmBind(a, rt.header);
+	asmData(a, (const uint8_t *)header, strlen(header));
+	asmBind(a, rt.path);
+	asmData(a, (const uint8_t *)path, strlen(path) + 1);
+	return true;
+}
+
+size_t newInstructionLabels(Assembler * a, size_t first, size_t last)
+{
+	// Wraps around when first is past the labels so far, the sum with an ip in range is still right
+	size_t firstLabel = a->labels.count - first;
+	for (size_t i = first; i <= last; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), ".INSTRUCTION_%zu", i);
+		asmNewLabel(a, name);
+	}
+	return firstLabel;
+}
+
+// Lays out the whole executable, the entry point is the returned label
+// With instrument the counters go out to <name>.counts in the working directory at exit, like gprof's gmon.out
+static bool compile_program(Assembler * a, InstructionArray * instructions, const char * filePath, bool instrument, size_t * start)
+{
+	OutputRuntime rt = new_output_runtime(a);
+	*start = asmNewLabel(a, "_start");
+	size_t firstLabel = newInstructionLabels(a, 0, instructions->count);
+	size_t exit = asmNewLabel(a, ".EXIT");
+	size_t * blockOf = NULL;
+	size_t blocks = 0;
+	CountsRuntime counts = {0};
+	if (instrument) {
+		blockOf = malloc((instructions->count + 1) * sizeof(*blockOf));
+		assert(blockOf != NULL && "Buy more RAM lol");
+		blocks = findBasicBlocks(instructions, blockOf);
+		counts = new_counts_runtime(a);
+	}
+	asmText(a, "segment .bss\n");
+	asmReserve(a, rt.filled, 8);
+	asmReserve(a, rt.buffer, OUTPUT_DEFAULT_CAPACITY);
+	if (instrument) asmReserve(a, counts.counters, (blocks > 0 ? blocks : 1) * 8);
+	asmText(a, "\n");
+	asmText(a, "segment .text\n");
+	asmText(a, "\n");
+	compile_output_runtime(a, rt);
+	if (instrument && !compile_counts_runtime(a, counts, filePath, blocks)) {
+		free(blockOf);
+		return false;
+	}
+	asmText(a, "\n");
+	asmGlobal(a, *start);
+	asmBind(a, *start);
+	// The depths are only used to keep items in registers across jumps, the program can be compiled without them
+	StackEffects effects = {0};
+	bool verified = verifyStackEffects(instructions, &effects, false);
 	size_t stack_count = 0;
-	for (size_t i = 0; i < instructions->count; i++) {
-		compileInstruction(&stack_count, i, instructions->items[i], out);
-	}
-	fprintf(out, ".INSTRUCTION_%zu:\n", instructions->count);
-	fprintf(out, ".EXIT:\n");
-	fprintf(out, "    mov     rax, 60\n");
-	fprintf(out, "    mov     rdi, 0\n");
-	fprintf(out, "    syscall\n");
-	fclose(out);
-	
+	Instrumentation instrumentation = { counts.counters, blockOf };
+	bool result = compileInstructions(a, instructions, 0, instructions->count, firstLabel, rt.dump, verified ? effects.depths : NULL, &stack_count, instrument ? &instrumentation : NULL);
+	freeStackEffects(&effects);
+	free(blockOf);
+	asmBind(a, exit);
+	asmCall(a, rt.flush);
+	if (instrument) asmCall(a, counts.write);
+	asmOp2(a, MN_MOV, r64(RAX), imm(60));
+	asmOp2(a, MN_MOV, r64(RDI), imm(0));
+	asmOp0(a, MN_SYSCALL);
+	return result;
+}
+
+// The routine runs on the caller's stack, keep well clear of the usual 8MB limit
+#define ROUTINE_MAX_DEPTH (256*1024)
+
+// The labels an object exports, in the order they are laid out
+enum {
+	ROUTINE_MAIN = 0,
+	ROUTINE_NEEDED,
+	ROUTINE_RESULTS,
+	ROUTINE_SYMBOLS,
+};
+
+// The program's registers are the callee saved ones and rbp holds the base of its stack
+static const Register callee_saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+// Lays out minos_main and the sizes that go with it for an object, as described in compiler.h
+static bool compile_routine(Assembler * a, InstructionArray * instructions, const char * filePath, size_t labels[ROUTINE_SYMBOLS])
+{
+	// Unlike a whole program it starts with items on the stack, so it can't do without their count
+	StackEffects effects = {0};
+	if (!verifyRoutine(instructions, &effects, true)) {
+		nob_log(NOB_ERROR, "%s: An object needs a stack effect that is known at compile time", filePath);
+		freeStackEffects(&effects);
+		return false;
+	}
+	if (effects.maxDepth > ROUTINE_MAX_DEPTH) {
+		nob_log(NOB_ERROR, "%s: An object can't use more than %d items of the stack", filePath, ROUTINE_MAX_DEPTH);
+		freeStackEffects(&effects);
+		return false;
+	}
+	size_t needed = effects.depths[0];
+	size_t results = effects.depths[instructions->count];
+
+	labels[ROUTINE_MAIN] = asmNewLabel(a, "minos_main");
+	labels[ROUTINE_NEEDED] = asmNewLabel(a, "minos_needed");
+	labels[ROUTINE_RESULTS] = asmNewLabel(a, "minos_results");
+	size_t dump = asmNewLabel(a, ".dump");
+	size_t copyIn = asmNewLabel(a, ".copyIn");
+	size_t copyInCheck = asmNewLabel(a, ".copyInCheck");
+	size_t copyOut = asmNewLabel(a, ".copyOut");
+	size_t copied = asmNewLabel(a, ".copied");
+	size_t done = asmNewLabel(a, ".return");
+	size_t firstLabel = newInstructionLabels(a, 0, instructions->count);
+	asmText(a, "segment .text\n");
+	asmText(a, "\n");
+	for (size_t i = 0; i < ROUTINE_SYMBOLS; i++) asmGlobal(a, labels[i]);
+	asmBind(a, labels[ROUTINE_MAIN]);
+	for (size_t i = 0; i < NOB_ARRAY_LEN(callee_saved); i++) {
+		asmOp1(a, MN_PUSH, r64(callee_saved[i]));
+	}
+	asmOp2(a, MN_MOV, r32(RAX), imm(1));
+	asmOp2(a, MN_CMP, mem(8, RSI, 0), imm(needed));
+	asmJcc(a, CC_B, done);
+	// The arguments stay right above the native stack of the program, out at [rbp], depth at [rbp + 8] and stack at [rbp + 16]
+	asmOp1(a, MN_PUSH, r64(RDI));
+	asmOp1(a, MN_PUSH, r64(RSI));
+	asmOp1(a, MN_PUSH, r64(RDX));
+	asmOp2(a, MN_MOV, r64(RBP), r64(RSP));
+	asmOp2(a, MN_MOV, r64(RAX), mem(8, RSI, 0));
+	asmOp2(a, MN_LEA, r64(RDI), memIndex(8, RDI, RAX, 8, -(int32_t)(needed * 8)));
+	asmOp2(a, MN_XOR, r32(RCX), r32(RCX));
+	asmJmp(a, copyInCheck);
+	asmBind(a, copyIn);
+	asmOp2(a, MN_MOVSXD, r64(R8), memIndex(4, RDI, RCX, 8, 0));
+	asmOp1(a, MN_PUSH, r64(R8));
+	asmOp1(a, MN_INC, r64(RCX));
+	asmBind(a, copyInCheck);
+	asmOp2(a, MN_CMP, r64(RCX), imm(needed));
+	asmJcc(a, CC_B, copyIn);
+
+	bool result = compileInstructions(a, instructions, 0, instructions->count, firstLabel, dump, effects.depths, NULL, NULL);
+	freeStackEffects(&effects);
+	// The results are on the native stack now, the bottom one at [rbp - 8], and go where the items it took were
+	asmOp2(a, MN_MOV, r64(RSI), mem(8, RBP, 8));
+	asmOp2(a, MN_MOV, r64(RAX), mem(8, RSI, 0));
+	asmOp2(a, MN_MOV, r64(RDI), mem(8, RBP, 16));
+	asmOp2(a, MN_LEA, r64(RDI), memIndex(8, RDI, RAX, 8, -(int32_t)(needed * 8)));
+	asmOp2(a, MN_MOV, r64(RDX), r64(RBP));
+	asmOp2(a, MN_XOR, r32(RCX), r32(RCX));
+	asmBind(a, copyOut);
+	asmOp2(a, MN_CMP, r64(RCX), imm(results));
+	asmJcc(a, CC_AE, copied);
+	asmOp2(a, MN_SUB, r64(RDX), imm(8));
+	asmOp2(a, MN_MOV, r64(R8), mem(8, RDX, 0));
+	asmOp2(a, MN_MOV, memIndex(8, RDI, RCX, 8, 0), r64(R8));
+	asmOp1(a, MN_INC, r64(RCX));
+	asmJmp(a, copyOut);
+	asmBind(a, copied);
+	asmOp2(a, MN_ADD, r64(RAX), imm((int64_t)results - (int64_t)needed));
+	asmOp2(a, MN_MOV, mem(8, RSI, 0), r64(RAX));
+	asmOp2(a, MN_LEA, r64(RSP), mem(8, RBP, 24));
+	asmOp2(a, MN_XOR, r32(RAX), r32(RAX));
+	asmBind(a, done);
+	for (size_t i = NOB_ARRAY_LEN(callee_saved); i > 0; i--) {
+		asmOp1(a, MN_POP, r64(callee_saved[i - 1]));
+	}
+	asmOp0(a, MN_RET);
+
+	// out gets the value in rdi and an aligned stack
+	asmBind(a, dump);
+	asmOp1(a, MN_PUSH, r64(RBX));
+	asmOp2(a, MN_MOV, r64(RBX), r64(RSP));
+	asmOp2(a, MN_AND, r64(RSP), imm(-16));
+	asmOp1(a, MN_CALL, mem(8, RBP, 0));
+	asmOp2(a, MN_MOV, r64(RSP), r64(RBX));
+	asmOp1(a, MN_POP, r64(RBX));
+	asmOp0(a, MN_RET);
+
+	uint64_t sizes[] = { needed, results };
+	for (size_t i = 0; i < NOB_ARRAY_LEN(sizes); i++) {
+		uint8_t bytes[8];
+		for (size_t j = 0; j < sizeof(bytes); j++) bytes[j] = sizes[i] >> (8 * j);
+		asmBind(a, labels[ROUTINE_NEEDED + i]);
+		asmData(a, bytes, sizeof(bytes));
+	}
+	return result;
+}
+
+// What the compiler writes goes next to the source, named like it with extension instead of its own
+static char * output_path(const char * filePath, const char * extension)
+{
+	char * stem = strdup(filePath);
+	assert(stem != NULL && "Buy more RAM lol");
+	strip_ext(stem);
+	char * outFilePath = strdup(nob_temp_sprintf("%s%s", stem, extension));
+	assert(outFilePath != NULL && "Buy more RAM lol");
+	free(stem);
+	return outFilePath;
+}
+
+// nasm and ld get a directory of their own, so compiles running side by side never share a file
+static char * make_temp_dir(void)
+{
+	const char * tmp = getenv("TMPDIR");
+	char * dir = strdup(nob_temp_sprintf("%s/minos-XXXXXX", tmp && *tmp ? tmp : "/tmp"));
+	assert(dir != NULL && "Buy more RAM lol");
+	if (mkdtemp(dir) == NULL) {
+		nob_log(NOB_ERROR, "Could not create a temporary directory %s: %s", dir, strerror(errno));
+		free(dir);
+		return NULL;
+	}
+	return dir;
+}
+
+typedef struct {
+	const char * filePath;
+	char * outFilePath;
+	char * sourcePath; // What the external tools start from, nasm sources are kept next to the executable since that's what they're for
+	bool keepSource;
+	char * tmpDir;     // Holds whatever the tools write on the way
+	char * objectPath;
+	CacheKey key;
+	bool missed;       // Not in the cache, the executable goes in once it's built
+	bool pending;      // Has work left, the build and then the external tools
+	bool built;        // Linted and generated, in process or in a child of its own
+	size_t step;       // Next command of job_command
+	bool failed;
+	Nob_Proc proc;     // Child running the build or a command of the job
+} CompileJob;
+
+static const char * c_compiler(void)
+{
+	const char * cc = getenv("CC");
+	return cc && *cc ? cc : "cc";
+}
+
+// Line info names the source file and the directory it was compiled in, two files with the same bytes
+// mustn't share an executable then
+static const char * debug_options(const char * filePath, CompilerOptions options)
+{
+	if (!options.debug) return "";
+	char * source = realpath(filePath, NULL);
+	char * cwd = getcwd(NULL, 0);
+	const char * result = nob_temp_sprintf(" debug source=%s cwd=%s", source ? source : filePath, cwd ? cwd : ".");
+	free(source);
+	free(cwd);
+	return result;
+}
+
+// The counters go to a file named after the source and start with its absolute path
+static const char * instrument_options(const char * filePath, CompilerOptions options)
+{
+	if (!options.instrument) return "";
+	char * source = realpath(filePath, NULL);
+	const char * result = nob_temp_sprintf(" instrument source=%s counts=%s", source ? source : filePath, counts_path(filePath));
+	free(source);
+	return result;
+}
+
+// Everything besides the source that changes what comes out, for the cache key
+static const char * codegen_options(const char * filePath, CompilerOptions options)
+{
+	const char * debug = debug_options(filePath, options);
+	switch (options.backend) {
+	case BACKEND_NATIVE: return nob_temp_sprintf("asm=%s%s%s%s", options.nasm ? "nasm" : "builtin", options.emit == EMIT_OBJECT ? " emit=obj" : "", debug, instrument_options(filePath, options));
+	case BACKEND_C: return nob_temp_sprintf("backend=c cc=%s%s", c_compiler(), debug);
+	default:
+		assert(false && "Unreachable");
+		return NULL;
+	}
+}
+
+static bool uses_tools(CompilerOptions options)
+{
+	return options.backend == BACKEND_C || options.nasm;
+}
+
+// Set up before the build, which may run in a child that can't hand anything back
+static bool prepare_sources(CompileJob * job, const char * sourcePath, bool keepSource)
+{
+	job->tmpDir = make_temp_dir();
+	if (job->tmpDir == NULL) return false;
+	job->sourcePath = strdup(keepSource ? sourcePath : nob_temp_sprintf("%s/%s", job->tmpDir, sourcePath));
+	assert(job->sourcePath != NULL && "Buy more RAM lol");
+	job->keepSource = keepSource;
+	job->objectPath = strdup(nob_temp_sprintf("%s/out.o", job->tmpDir));
+	assert(job->objectPath != NULL && "Buy more RAM lol");
+	return true;
+}
+
+static bool open_source(CompileJob * job, FILE ** out)
+{
+	*out = fopen(job->sourcePath, "w");
+	if (*out == NULL) {
+		nob_log(NOB_ERROR, "Could not open %s: %s", job->sourcePath, strerror(errno));
+		return false;
+	}
+	return true;
+}
+
+static bool write_nasm_source(CompileJob * job, InstructionArray * instructions, CompilerOptions options)
+{
+	FILE * out = NULL;
+	if (!open_source(job, &out)) return false;
+	Assembler a;
+	asmInit(&a, out);
+	a.lineInfo = options.debug;
+	bool result;
+	if (options.emit == EMIT_OBJECT) {
+		size_t labels[ROUTINE_SYMBOLS];
+		result = compile_routine(&a, instructions, job->filePath, labels);
+	} else {
+		size_t start;
+		result = compile_program(&a, instructions, job->filePath, options.instrument, &start);
+	}
+	asmFree(&a);
+	return fclose(out) == 0 && result;
+}
+
+static bool write_c_source(CompileJob * job, InstructionArray * instructions, bool lines)
+{
+	FILE * out = NULL;
+	if (!open_source(job, &out)) return false;
+	bool result = transpileToC(instructions, out, lines);
+	return fclose(out) == 0 && result;
+}
+
+// The labels that aren't local to another one, like _start and the runtime, as symbols so profilers
+// have something to group the code by. Each one runs up to the next.
+static size_t code_symbols(const Assembler * a, ElfSymbol ** symbols)
+{
+	*symbols = malloc(a->labels.count * sizeof(**symbols));
+	assert(*symbols != NULL && "Buy more RAM lol");
+	size_t count = 0;
+	for (size_t i = 0; i < a->labels.count; i++) {
+		Label label = a->labels.items[i];
+		if (!label.bound || label.reserved || label.name[0] == '.') continue;
+		// Sorted by offset as they go in
+		size_t j = count++;
+		for (; j > 0 && (*symbols)[j - 1].offset > label.offset; j--) (*symbols)[j] = (*symbols)[j - 1];
+		(*symbols)[j] = (ElfSymbol) { label.name, label.offset, 0, !label.data };
+	}
+	for (size_t i = 0; i < count; i++) {
+		size_t end = i + 1 < count ? (*symbols)[i + 1].offset : a->code.count;
+		(*symbols)[i].size = end - (*symbols)[i].offset;
+	}
+	return count;
+}
+
+static bool write_executable(CompileJob * job, InstructionArray * instructions, bool debug, bool instrument)
+{
+	Assembler a;
+	asmInit(&a, NULL);
+	a.lineInfo = debug;
+	size_t start;
+	if (!compile_program(&a, instructions, job->filePath, instrument, &start)) {
+		asmFree(&a);
+		return false;
+	}
+	a.reservedOffset = elfReservedOffset(a.code.count);
+	asmResolve(&a);
+	bool result;
+	if (debug) {
+		DwarfSections dwarf = {0};
+		char * compDir = getcwd(NULL, 0);
+		dwarfLineInfo(a.lines.items, a.lines.count, elfCodeAddress(), a.code.count, compDir ? compDir : ".", &dwarf);
+		free(compDir);
+		ElfSection sections[] = {
+			{ ".debug_abbrev", dwarf.abbrev.items, dwarf.abbrev.count },
+			{ ".debug_info", dwarf.info.items, dwarf.info.count },
+			{ ".debug_line", dwarf.line.items, dwarf.line.count },
+		};
+		ElfSymbol * symbols = NULL;
+		size_t symbolCount = code_symbols(&a, &symbols);
+		ElfDebug info = { sections, NOB_ARRAY_LEN(sections), symbols, symbolCount };
+		result = writeElfExecutable(job->outFilePath, a.code.items, a.code.count, a.labels.items[start].offset, a.reservedSize, &info);
+		free(symbols);
+		dwarfFree(&dwarf);
+	} else {
+		result = writeElfExecutable(job->outFilePath, a.code.items, a.code.count, a.labels.items[start].offset, a.reservedSize, NULL);
+	}
+	asmFree(&a);
+	return result;
+}
+
+static bool write_object(CompileJob * job, InstructionArray * instructions)
+{
+	Assembler a;
+	asmInit(&a, NULL);
+	size_t labels[ROUTINE_SYMBOLS];
+	if (!compile_routine(&a, instructions, job->filePath, labels)) {
+		asmFree(&a);
+		return false;
+	}
+	asmResolve(&a);
+	ElfSymbol symbols[ROUTINE_SYMBOLS];
+	for (size_t i = 0; i < ROUTINE_SYMBOLS; i++) {
+		Label label = a.labels.items[labels[i]];
+		size_t end = i + 1 < ROUTINE_SYMBOLS ? a.labels.items[labels[i + 1]].offset : a.code.count;
+		symbols[i] = (ElfSymbol) { label.name, label.offset, end - label.offset, i == ROUTINE_MAIN };
+	}
+	bool result = writeElfObject(job->outFilePath, a.code.items, a.code.count, symbols, ROUTINE_SYMBOLS);
+	asmFree(&a);
+	return result;
+}
+
+// Finds out whether the job has anything to do and sets up its paths
+static void start_job(CompileJob * job, CompilerOptions options)
+{
+	job->outFilePath = output_path(job->filePath, options.emit == EMIT_OBJECT ? ".o" : "");
+	if (!options.noCache && cacheDirectory() != NULL) {
+		if (!cacheKey(job->filePath, codegen_options(job->filePath, options), &job->key)) {
+			job->failed = true;
+			return;
+		}
+		if (cacheFetch(&job->key, job->outFilePath)) return;
+		job->missed = true;
+	}
+
+	if (unlink(job->outFilePath) < 0 && errno != ENOENT) {
+		// The old executable may be a hard link into the cache, writing into it would change the cached one too
+		nob_log(NOB_ERROR, "Could not remove %s: %s", job->outFilePath, strerror(errno));
+		job->failed = true;
+	} else if (options.backend == BACKEND_C) {
+		job->failed = !prepare_sources(job, "out.c", false);
+	} else if (options.nasm) {
+		char * asmPath = output_path(job->filePath, ".asm");
+		job->failed = !prepare_sources(job, asmPath, true);
+		free(asmPath);
+	}
+	job->pending = !job->failed;
+}
+
+// Everything up to the point where external tools take over, which is all of it for the builtin assembler
+static bool build_job(CompileJob * job, CompilerOptions options)
+{
+	InstructionArray instructions = {0};
+	bool result = lintInstructionsFromFile(job->filePath, &instructions);
+	if (!result) {
+		// Already reported
+	} else if (options.backend == BACKEND_C) {
+		result = write_c_source(job, &instructions, options.debug);
+	} else if (options.nasm) {
+		result = write_nasm_source(job, &instructions, options);
+	} else if (options.emit == EMIT_OBJECT) {
+		result = write_object(job, &instructions);
+	} else {
+		result = write_executable(job, &instructions, options.debug, options.instrument);
+	}
+	nob_da_free(instructions);
+	return result;
+}
+
+// The next external command of the job, false once there are none left
+static bool job_command(CompileJob * job, CompilerOptions options, Nob_Cmd * cmd)
+{
+	cmd->count = 0;
+	size_t step = job->step++;
+	if (options.backend == BACKEND_C) {
+		if (step > 0) return false;
+		nob_cmd_append(cmd, c_compiler(), "-O2", "-w");
+		if (options.debug) nob_cmd_append(cmd, "-g");
+		nob_cmd_append(cmd, "-o", job->outFilePath, job->sourcePath);
+		return true;
+	}
+	switch (step) {
+	case 0:
+		// An object is what nasm writes anyway
+		nob_cmd_append(cmd, "nasm", "-felf64");
+		if (options.debug) nob_cmd_append(cmd, "-g", "-F", "dwarf");
+		nob_cmd_append(cmd, "-o", options.emit == EMIT_OBJECT ? job->outFilePath : job->objectPath, job->sourcePath);
+		return true;
+	case 1:
+		if (options.emit == EMIT_OBJECT) return false;
+		nob_cmd_append(cmd, "ld", "-o", job->outFilePath, job->objectPath);
+		return true;
+	default:
+		return false;
+	}
+}
+
+// Starts what the job does next in a child, the build forked off when there are other jobs to overlap with and
+// then its commands. False once it has nothing left to start.
+static bool start_step(CompileJob * job, CompilerOptions options, bool forkBuild, Nob_Cmd * cmd)
+{
+	if (!job->built) {
+		job->built = true;
+		if (forkBuild) {
+			job->proc = fork();
+			// _exit leaves the stdio buffers the child got from the parent alone
+			if (job->proc == 0) _exit(build_job(job, options) ? 0 : 1);
+			if (job->proc > 0) return true;
+			nob_log(NOB_ERROR, "Could not fork to compile %s: %s", job->filePath, strerror(errno));
+			job->failed = true;
+		} else {
+			job->failed = !build_job(job, options);
+		}
+	}
+	if (!job->failed && uses_tools(options) && job_command(job, options, cmd)) {
+		job->proc = nob_cmd_run_async(*cmd);
+		if (job->proc != NOB_INVALID_PROC) return true;
+		job->failed = true;
+	}
+	job->pending = false;
+	return false;
+}
+
+static void finish_job(CompileJob * job)
+{
+	if (!job->failed && job->missed) cacheStore(&job->key, job->outFilePath);
+	if (job->sourcePath && !job->keepSource) unlink(job->sourcePath);
+	if (job->objectPath) unlink(job->objectPath);
+	if (job->tmpDir) rmdir(job->tmpDir);
+	free(job->outFilePath);
+	free(job->sourcePath);
+	free(job->tmpDir);
+	free(job->objectPath);
+	nob_da_free(job->key);
+}
+
+bool compileFiles(const char ** filePaths, size_t count, CompilerOptions options)
+{
+	CompileJob * jobs = calloc(count, sizeof(*jobs));
+	assert(jobs != NULL && "Buy more RAM lol");
+	for (size_t i = 0; i < count; i++) {
+		jobs[i].filePath = filePaths[i];
+		start_job(&jobs[i], options);
+	}
+
+	// As many children as there are cores, a slot is refilled as soon as its child exits, with the job's next
+	// command if it has one and with the next job otherwise
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t width = cores > 0 ? (size_t)cores : 1;
+	bool forkBuild = count > 1;
+	Nob_Procs running = {0};
 	Nob_Cmd cmd = {0};
-	nob_cmd_append(&cmd, "nasm");
-	nob_cmd_append(&cmd, "-felf64", "tmp.asm");
-	if (!nob_cmd_run_sync(cmd)) exit(1);
-
-	cmd.count = 0;
-	nob_cmd_append(&cmd, "ld");
-	nob_cmd_append(&cmd, "-o", outFilePath, "tmp.o");
-	if (!nob_cmd_run_sync(cmd)) exit(1);
+	size_t next = 0;
+	for (;;) {
+		for (; next < count && running.count < width; next++) {
+			if (jobs[next].pending && start_step(&jobs[next], options, forkBuild, &cmd)) nob_da_append(&running, jobs[next].proc);
+		}
+		if (running.count == 0) break;
+
+		// Takes whichever child is done already and only sleeps when none is
+		int status = 0;
+		Nob_Proc proc = waitpid(-1, &status, WNOHANG);
+		if (proc == 0) proc = waitpid(-1, &status, 0);
+		if (proc < 0) {
+			if (errno == EINTR) continue;
+			nob_log(NOB_ERROR, "Could not wait for the compile jobs: %s", strerror(errno));
+			for (size_t i = 0; i < count; i++) jobs[i].failed = jobs[i].failed || jobs[i].pending;
+			break;
+		}
+		size_t slot = 0;
+		while (slot < running.count && running.items[slot] != proc) slot++;
+		if (slot == running.count) continue;
+		running.items[slot] = running.items[--running.count];
+
+		CompileJob * job = NULL;
+		for (size_t i = 0; i < count && job == NULL; i++) {
+			if (jobs[i].pending && jobs[i].proc == proc) job = &jobs[i];
+		}
+		assert(job != NULL && "Unreachable");
+		if (WIFSIGNALED(status)) {
+			nob_log(NOB_ERROR, "Compiling %s was terminated by %s", job->filePath, strsignal(WTERMSIG(status)));
+			job->failed = true;
+			job->pending = false;
+		} else if (WEXITSTATUS(status) != 0) {
+			// A build that failed in a child has said why already
+			if (job->step > 0) nob_log(NOB_ERROR, "Command for %s exited with exit code %d", job->filePath, WEXITSTATUS(status));
+			job->failed = true;
+			job->pending = false;
+		} else if (start_step(job, options, forkBuild, &cmd)) {
+			nob_da_append(&running, job->proc);
+		}
+	}
+	nob_cmd_free(cmd);
+	nob_da_free(running);
+
+	bool result = true;
+	for (size_t i = 0; i < count; i++) {
+		finish_job(&jobs[i]);
+		result = result && !jobs[i].failed;
+	}
+	free(jobs);
+	return result;
 }
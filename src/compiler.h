@@ -2,8 +2,61 @@
 #define _COMPILER_H_
 
 #include "types.h"
+#include "x86.h"
 #include <stdio.h>
 
-void compileProgram(InstructionArray * instructions, const char * filepath);
+// Splits the program into basic blocks, straight runs of instructions that are only entered at the top and only
+// left at the bottom. blockOf gets the index of the block each instruction belongs to, the count is returned.
+size_t findBasicBlocks(const InstructionArray * instructions, size_t * blockOf);
+
+// An instrumented executable writes a .counts file at exit, starting with a line of
+// "minos-counts 1 <blocks> <absolute source path>" followed by the counters as little endian uint64s
+#define COUNTS_MAGIC "minos-counts 1"
+
+// Counts how often each basic block runs
+typedef struct {
+	size_t counters;        // Label of a uint64 counter per block
+	const size_t * blockOf; // From findBasicBlocks
+} Instrumentation;
+
+// Creates the .INSTRUCTION_<first> to .INSTRUCTION_<last> labels, the label of instruction ip is the result + ip
+size_t newInstructionLabels(Assembler * a, size_t first, size_t last);
+// Compiles the instructions in [first, stop) and binds .INSTRUCTION_<stop> after them, where every item is on the native stack.
+// Values are sign extended int32s, the top few of them are kept in rbx and r12 to r15 and the rest on the native stack.
+// With the depths from the verifier some of them also stay in registers across jumps, without them everything is spilled.
+// dump is called with the value in rdi and may change any register that isn't callee saved.
+// stack_count tracks the depth in program order to reject underflows, pass NULL when the program was verified.
+// instrument can be NULL. Returns false when it reported an underflow.
+bool compileInstructions(Assembler * a, const InstructionArray * instructions, size_t first, size_t stop, size_t firstLabel, size_t dump, const size_t * depths, size_t * stack_count, const Instrumentation * instrument);
+typedef enum {
+	BACKEND_NATIVE = 0, // Generates x86-64 itself
+	BACKEND_C,          // Translates to C and leaves the rest to the system's C compiler
+} Backend;
+
+// An object file has the program as a function to call from C:
+//     typedef void (*minos_write_fn)(int64_t value);
+//     int minos_main(int64_t * stack, size_t * depth, minos_write_fn out);
+//     extern const size_t minos_needed, minos_results;
+// It runs with the *depth items of stack on its stack, stack[*depth - 1] being the top, and calls out for every dump.
+// It takes the top minos_needed items and leaves minos_results items in their place, updating *depth, so stack needs
+// room for *depth - minos_needed + minos_results items. Returns 0, or 1 without running when there are fewer than
+// minos_needed items. The items are int32s like everywhere else, only the low 32 bits of the ones passed in count.
+typedef enum {
+	EMIT_EXECUTABLE = 0,
+	EMIT_OBJECT,
+} Emit;
+
+typedef struct {
+	Backend backend;
+	Emit emit;
+	bool nasm; // Go through nasm and ld instead of encoding the executable directly, handy to read the assembly
+	bool noCache; // Always compile, without looking into or adding to the cache
+	bool debug;   // Line info for debuggers and profilers, mapping the code back to the source
+	bool instrument; // Count basic blocks and write the counts to <name>.counts at exit, for minos report
+} CompilerOptions;
+
+// Lints and compiles every file into an executable next to it, or takes the executable from the cache when the same
+// file was compiled the same way before. The nasm and ld runs of different files go on side by side.
+bool compileFiles(const char ** filePaths, size_t count, CompilerOptions options);
 
 #endif // _COMPILER_H_
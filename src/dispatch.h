@@ -0,0 +1,292 @@
+// Body of the threaded bytecode interpreter, included once per engine variant by interpreter.c.
+// HANDLER and NEXT come from interpreter.c, the includer also defines:
+//     ENGINE_NAME     name of the generated function
+//     ENGINE_CHECKED  1 to check every pop for underflow and every push for growth,
+//                     0 for programs whose stack effects were verified up front
+//     ENGINE_TAGGED   1 to keep tagged Values on the stack, 0 for a bare int32_t stack
+//                     when every value was proven to be an I32 (needs ENGINE_CHECKED 0)
+//     ENGINE_TIERED   1 to count loop back-edges and hand hot loops over to native code,
+//                     optional and 0 by default
+//     ENGINE_HOOK     function or macro to call with the ip of every op before it runs,
+//                     optional so the engines without one don't pay for it
+
+#ifndef ENGINE_NAME
+#error "ENGINE_NAME has to be defined before including dispatch.h"
+#endif
+
+#ifndef ENGINE_TIERED
+#define ENGINE_TIERED 0
+#endif
+
+#ifdef ENGINE_HOOK
+#define OP(opcode) HANDLER(opcode) ENGINE_HOOK(ip);
+#else
+#define OP(opcode) HANDLER(opcode)
+#endif
+
+#if ENGINE_CHECKED && !ENGINE_TAGGED
+#error "The checked engine has to keep tagged values"
+#endif
+
+#if ENGINE_TAGGED
+#define SLOT Value
+#define BOX(n) i32Value(n)
+#define UNBOX(v) asI32(v)
+#else
+#define SLOT int32_t
+#define BOX(n) (n)
+#define UNBOX(v) (v)
+#endif
+
+// Fused ops pass the component that would have done the pop in the unfused stream
+#if ENGINE_CHECKED
+#define POP_AT(v, component) \
+	do { \
+		if (sp == stack.items) stackUnderflow(bytecode, ip, (component)); \
+		(v) = *--sp; \
+	} while (0)
+#define PUSH(v) \
+	do { \
+		if (sp == stack.items + stack.capacity) sp = growStack(&stack.items, &stack.capacity, sp); \
+		*sp++ = (v); \
+	} while (0)
+#else
+#define POP_AT(v, component) ((v) = *--sp)
+#define PUSH(v) (*sp++ = (v))
+#endif
+#define POP(v) POP_AT(v, 0)
+
+static void ENGINE_NAME(const Bytecode * bytecode, size_t maxDepth)
+{
+	struct {
+		SLOT * items;
+		size_t capacity;
+	} stack = {0};
+	stack.capacity = maxDepth > 0 ? maxDepth : 1;
+	stack.items = malloc(stack.capacity * sizeof(*stack.items));
+	assert(stack.items != NULL && "Buy more RAM lol");
+	SLOT * sp = stack.items;
+
+	const Op * code = bytecode->ops.items;
+	size_t ip = 0;
+	SLOT a, b;
+
+#ifdef THREADED_DISPATCH
+	static void * const handlers[OP_COUNT] = {
+		[OP_PUSH] = &&handler_OP_PUSH,
+		[OP_PLUS] = &&handler_OP_PLUS,
+		[OP_MINUS] = &&handler_OP_MINUS,
+		[OP_MULTIPLY] = &&handler_OP_MULTIPLY,
+		[OP_DIVIDE] = &&handler_OP_DIVIDE,
+		[OP_DUMP] = &&handler_OP_DUMP,
+		[OP_EQUAL] = &&handler_OP_EQUAL,
+		[OP_DUP] = &&handler_OP_DUP,
+		[OP_GT] = &&handler_OP_GT,
+		[OP_LT] = &&handler_OP_LT,
+		[OP_JMP] = &&handler_OP_JMP,
+		[OP_JZ] = &&handler_OP_JZ,
+		[OP_HALT] = &&handler_OP_HALT,
+		[OP_PUSH_PLUS] = &&handler_OP_PUSH_PLUS,
+		[OP_PUSH_MINUS] = &&handler_OP_PUSH_MINUS,
+		[OP_PUSH_MULTIPLY] = &&handler_OP_PUSH_MULTIPLY,
+		[OP_PUSH_DIVIDE] = &&handler_OP_PUSH_DIVIDE,
+		[OP_PUSH_EQUAL] = &&handler_OP_PUSH_EQUAL,
+		[OP_PUSH_GT] = &&handler_OP_PUSH_GT,
+		[OP_PUSH_LT] = &&handler_OP_PUSH_LT,
+		[OP_EQUAL_JZ] = &&handler_OP_EQUAL_JZ,
+		[OP_GT_JZ] = &&handler_OP_GT_JZ,
+		[OP_LT_JZ] = &&handler_OP_LT_JZ,
+		[OP_PUSH_EQUAL_JZ] = &&handler_OP_PUSH_EQUAL_JZ,
+		[OP_PUSH_GT_JZ] = &&handler_OP_PUSH_GT_JZ,
+		[OP_PUSH_LT_JZ] = &&handler_OP_PUSH_LT_JZ,
+		[OP_DUP_PUSH_EQUAL] = &&handler_OP_DUP_PUSH_EQUAL,
+		[OP_DUP_PUSH_GT] = &&handler_OP_DUP_PUSH_GT,
+		[OP_DUP_PUSH_LT] = &&handler_OP_DUP_PUSH_LT,
+		[OP_DUP_PUSH_EQUAL_JZ] = &&handler_OP_DUP_PUSH_EQUAL_JZ,
+		[OP_DUP_PUSH_GT_JZ] = &&handler_OP_DUP_PUSH_GT_JZ,
+		[OP_DUP_PUSH_LT_JZ] = &&handler_OP_DUP_PUSH_LT_JZ,
+	};
+
+	// Every handler jumps straight to the handler of the next op, the op stream
+	// ends in OP_HALT so there is no bounds check on ip either
+	NEXT(0);
+#else
+dispatch:
+	switch (code[ip].opcode) {
+#endif
+	OP(OP_PUSH)
+		PUSH(BOX(code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PLUS)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) + UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_MINUS)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) - UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_MULTIPLY)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) * UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_DIVIDE)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) / UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_DUMP)
+		POP(a);
+		outputI32(&output, UNBOX(a));
+		NEXT(ip + 1);
+	OP(OP_EQUAL)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) == UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_DUP)
+		POP(a);
+		PUSH(a);
+		PUSH(a);
+		NEXT(ip + 1);
+	OP(OP_GT)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) > UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_LT)
+		POP(b);
+		POP(a);
+		PUSH(BOX(UNBOX(a) < UNBOX(b)));
+		NEXT(ip + 1);
+	OP(OP_JMP)
+#if ENGINE_TIERED
+		// Only the 'end' of a loop jumps backwards, the loop exits to the op right after it
+		if ((size_t)code[ip].operand < ip) {
+			const JitLoop * loop = hotLoop(bytecode, ip, sp - stack.items);
+			if (loop != NULL) {
+				size_t base = sp - stack.items - loop->needed;
+				int64_t * values = loopValues(loop->needed + loop->growth);
+				for (size_t i = 0; i < loop->needed; i++) {
+					values[i] = UNBOX(stack.items[base + i]);
+				}
+				size_t count = jitRunLoop(loop, values, loop->needed);
+#if ENGINE_CHECKED
+				while (base + count > stack.capacity) {
+					sp = growStack(&stack.items, &stack.capacity, sp);
+				}
+#endif
+				for (size_t i = 0; i < count; i++) {
+					stack.items[base + i] = BOX((int32_t)values[i]);
+				}
+				sp = stack.items + base + count;
+				NEXT(ip + 1);
+			}
+		}
+#endif
+		NEXT((size_t)code[ip].operand);
+	OP(OP_JZ)
+		POP(a);
+		NEXT(UNBOX(a) ? ip + 1 : (size_t)code[ip].operand);
+	OP(OP_HALT)
+		goto halt;
+	OP(OP_PUSH_PLUS)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) + code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_MINUS)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) - code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_MULTIPLY)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) * code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_DIVIDE)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) / code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_EQUAL)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) == code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_GT)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) > code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_PUSH_LT)
+		POP_AT(a, 1);
+		PUSH(BOX(UNBOX(a) < code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_EQUAL_JZ)
+		POP(b);
+		POP(a);
+		NEXT(UNBOX(a) == UNBOX(b) ? ip + 1 : (size_t)code[ip].operand);
+	OP(OP_GT_JZ)
+		POP(b);
+		POP(a);
+		NEXT(UNBOX(a) > UNBOX(b) ? ip + 1 : (size_t)code[ip].operand);
+	OP(OP_LT_JZ)
+		POP(b);
+		POP(a);
+		NEXT(UNBOX(a) < UNBOX(b) ? ip + 1 : (size_t)code[ip].operand);
+	OP(OP_PUSH_EQUAL_JZ)
+		POP_AT(a, 1);
+		NEXT(UNBOX(a) == code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	OP(OP_PUSH_GT_JZ)
+		POP_AT(a, 1);
+		NEXT(UNBOX(a) > code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	OP(OP_PUSH_LT_JZ)
+		POP_AT(a, 1);
+		NEXT(UNBOX(a) < code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	OP(OP_DUP_PUSH_EQUAL)
+		POP(a);
+		PUSH(a);
+		PUSH(BOX(UNBOX(a) == code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_DUP_PUSH_GT)
+		POP(a);
+		PUSH(a);
+		PUSH(BOX(UNBOX(a) > code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_DUP_PUSH_LT)
+		POP(a);
+		PUSH(a);
+		PUSH(BOX(UNBOX(a) < code[ip].operand));
+		NEXT(ip + 1);
+	OP(OP_DUP_PUSH_EQUAL_JZ)
+		POP(a);
+		PUSH(a);
+		NEXT(UNBOX(a) == code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	OP(OP_DUP_PUSH_GT_JZ)
+		POP(a);
+		PUSH(a);
+		NEXT(UNBOX(a) > code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	OP(OP_DUP_PUSH_LT_JZ)
+		POP(a);
+		PUSH(a);
+		NEXT(UNBOX(a) < code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+#ifndef THREADED_DISPATCH
+	default:
+		assert(false && "Unreachable");
+	}
+#endif
+
+halt:
+	free(stack.items);
+}
+
+#undef SLOT
+#undef BOX
+#undef UNBOX
+#undef POP_AT
+#undef POP
+#undef PUSH
+#undef ENGINE_NAME
+#undef ENGINE_CHECKED
+#undef ENGINE_TAGGED
+#undef ENGINE_TIERED
+#undef ENGINE_HOOK
+#undef OP
@@ -0,0 +1,209 @@
+#include "dwarf.h"
+
+#include "nob.h"
+
+
+#define DW_TAG_compile_unit 0x11
+#define DW_CHILDREN_no 0x00
+#define DW_AT_name 0x03
+#define DW_AT_stmt_list 0x10
+#define DW_AT_low_pc 0x11
+#define DW_AT_high_pc 0x12
+#define DW_AT_language 0x13
+#define DW_AT_comp_dir 0x1b
+#define DW_AT_producer 0x25
+#define DW_FORM_addr 0x01
+#define DW_FORM_data2 0x05
+#define DW_FORM_data8 0x07
+#define DW_FORM_string 0x08
+#define DW_FORM_sec_offset 0x17
+// There is no code for Minos, what nasm says about its output fits well enough
+#define DW_LANG_Mips_Assembler 0x8001
+
+#define DW_LNS_copy 0x01
+#define DW_LNS_advance_pc 0x02
+#define DW_LNS_advance_line 0x03
+#define DW_LNS_set_file 0x04
+#define DW_LNS_set_column 0x05
+#define DW_LNE_end_sequence 0x01
+#define DW_LNE_set_address 0x02
+
+// The line program only uses standard opcodes, the special ones just have to be described
+#define LINE_BASE -5
+#define LINE_RANGE 14
+#define OPCODE_BASE 13
+
+static void put_u8(ByteArray * out, uint8_t value)
+{
+	nob_da_append(out, value);
+}
+
+static void put_le(ByteArray * out, uint64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; i++) put_u8(out, value >> (8 * i));
+}
+
+static void put_uleb(ByteArray * out, uint64_t value)
+{
+	do {
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		put_u8(out, value != 0 ? byte | 0x80 : byte);
+	} while (value != 0);
+}
+
+static void put_sleb(ByteArray * out, int64_t value)
+{
+	for (;;) {
+		uint8_t byte = value & 0x7F;
+		value >>= 7;
+		bool done = (value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40));
+		put_u8(out, done ? byte : byte | 0x80);
+		if (done) return;
+	}
+}
+
+static void put_string(ByteArray * out, const char * string)
+{
+	nob_da_append_many(out, (const uint8_t *)string, strlen(string) + 1);
+}
+
+// Lengths are written once what they cover is there
+static void patch_u32(ByteArray * out, size_t at, uint32_t value)
+{
+	for (size_t i = 0; i < 4; i++) out->items[at + i] = value >> (8 * i);
+}
+
+// Files are numbered from 1 in the order they first show up
+static size_t file_index(const char ** files, size_t * count, const char * filePath)
+{
+	for (size_t i = 0; i < *count; i++) {
+		if (strcmp(files[i], filePath) == 0) return i + 1;
+	}
+	files[(*count)++] = filePath;
+	return *count;
+}
+
+static void line_program(const SourceLine * lines, size_t count, uint64_t address, size_t size, ByteArray * out)
+{
+	const char ** files = malloc((count + 1) * sizeof(*files));
+	assert(files != NULL && "Buy more RAM lol");
+	size_t fileCount = 0;
+	for (size_t i = 0; i < count; i++) file_index(files, &fileCount, lines[i].filePath);
+
+	size_t start = out->count;
+	put_le(out, 0, 4);
+	put_le(out, 4, 2);
+	size_t headerStart = out->count;
+	put_le(out, 0, 4);
+	put_u8(out, 1); // minimum_instruction_length
+	put_u8(out, 1); // maximum_operations_per_instruction
+	put_u8(out, 1); // default_is_stmt
+	put_u8(out, (uint8_t)LINE_BASE);
+	put_u8(out, LINE_RANGE);
+	put_u8(out, OPCODE_BASE);
+	static const uint8_t standardOpcodeLengths[OPCODE_BASE - 1] = { 0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1 };
+	nob_da_append_many(out, standardOpcodeLengths, sizeof(standardOpcodeLengths));
+	put_u8(out, 0); // No include directories besides the compilation directory
+	for (size_t i = 0; i < fileCount; i++) {
+		put_string(out, files[i]);
+		put_uleb(out, 0);
+		put_uleb(out, 0);
+		put_uleb(out, 0);
+	}
+	put_u8(out, 0);
+	patch_u32(out, headerStart, out->count - headerStart - 4);
+
+	put_u8(out, 0);
+	put_uleb(out, 9);
+	put_u8(out, DW_LNE_set_address);
+	put_le(out, address, 8);
+	size_t offset = 0;
+	size_t file = 1;
+	size_t line = 1;
+	size_t column = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (lines[i].offset != offset) {
+			put_u8(out, DW_LNS_advance_pc);
+			put_uleb(out, lines[i].offset - offset);
+			offset = lines[i].offset;
+		}
+		size_t index = file_index(files, &fileCount, lines[i].filePath);
+		if (index != file) {
+			put_u8(out, DW_LNS_set_file);
+			put_uleb(out, index);
+			file = index;
+		}
+		if (lines[i].line != line) {
+			put_u8(out, DW_LNS_advance_line);
+			put_sleb(out, (int64_t)lines[i].line - (int64_t)line);
+			line = lines[i].line;
+		}
+		if (lines[i].column != column) {
+			put_u8(out, DW_LNS_set_column);
+			put_uleb(out, lines[i].column);
+			column = lines[i].column;
+		}
+		put_u8(out, DW_LNS_copy);
+	}
+	if (size > offset) {
+		put_u8(out, DW_LNS_advance_pc);
+		put_uleb(out, size - offset);
+	}
+	put_u8(out, 0);
+	put_uleb(out, 1);
+	put_u8(out, DW_LNE_end_sequence);
+	patch_u32(out, start, out->count - start - 4);
+	free(files);
+}
+
+void dwarfLineInfo(const SourceLine * lines, size_t count, uint64_t address, size_t size, const char * compDir, DwarfSections * sections)
+{
+	*sections = (DwarfSections) {0};
+	line_program(lines, count, address, size, &sections->line);
+
+	// A single compilation unit covering all of the code, it's how tools find the line program
+	ByteArray * abbrev = &sections->abbrev;
+	put_uleb(abbrev, 1);
+	put_uleb(abbrev, DW_TAG_compile_unit);
+	put_u8(abbrev, DW_CHILDREN_no);
+	static const uint16_t attributes[][2] = {
+		{ DW_AT_producer, DW_FORM_string },
+		{ DW_AT_language, DW_FORM_data2 },
+		{ DW_AT_name, DW_FORM_string },
+		{ DW_AT_comp_dir, DW_FORM_string },
+		{ DW_AT_low_pc, DW_FORM_addr },
+		{ DW_AT_high_pc, DW_FORM_data8 },
+		{ DW_AT_stmt_list, DW_FORM_sec_offset },
+	};
+	for (size_t i = 0; i < NOB_ARRAY_LEN(attributes); i++) {
+		put_uleb(abbrev, attributes[i][0]);
+		put_uleb(abbrev, attributes[i][1]);
+	}
+	put_uleb(abbrev, 0);
+	put_uleb(abbrev, 0);
+	put_uleb(abbrev, 0);
+
+	ByteArray * info = &sections->info;
+	put_le(info, 0, 4);
+	put_le(info, 4, 2);
+	put_le(info, 0, 4); // debug_abbrev_offset
+	put_u8(info, 8);    // address_size
+	put_uleb(info, 1);
+	put_string(info, "minos " MINOS_VERSION);
+	put_le(info, DW_LANG_Mips_Assembler, 2);
+	put_string(info, count > 0 ? lines[0].filePath : "");
+	put_string(info, compDir);
+	put_le(info, address, 8);
+	put_le(info, size, 8);
+	put_le(info, 0, 4); // stmt_list
+	patch_u32(info, 0, info->count - 4);
+}
+
+void dwarfFree(DwarfSections * sections)
+{
+	nob_da_free(sections->abbrev);
+	nob_da_free(sections->info);
+	nob_da_free(sections->line);
+	*sections = (DwarfSections) {0};
+}
@@ -0,0 +1,19 @@
+#ifndef _DWARF_H
+#define _DWARF_H
+
+#include "types.h"
+#include "x86.h"
+
+// The sections debuggers and profilers need to map code back to the source, in DWARF 4
+typedef struct {
+	ByteArray abbrev;
+	ByteArray info;
+	ByteArray line;
+} DwarfSections;
+
+// Describes the size bytes of code loaded at address, lines are the places in it in the order of their offsets.
+// File names are taken as relative to compDir.
+void dwarfLineInfo(const SourceLine * lines, size_t count, uint64_t address, size_t size, const char * compDir, DwarfSections * sections);
+void dwarfFree(DwarfSections * sections);
+
+#endif // _DWARF_H
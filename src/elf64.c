@@ -0,0 +1,296 @@
+#include "elf64.h"
+
+#include "nob.h"
+
+#include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// The code follows the headers directly, so it sits at the same offset in the file and in memory.
+// There is room for a second program header whether it's used or not, so the code doesn't move.
+#define ELF_HEADERS_SIZE (sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr))
+#define ELF_PAGE_SIZE 0x1000
+
+static size_t align(size_t n, size_t alignment)
+{
+	return (n + alignment - 1) / alignment * alignment;
+}
+
+static bool write_file(const char * path, const Nob_String_Builder * sb, mode_t mode)
+{
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, mode);
+	if (fd < 0) {
+		nob_log(NOB_ERROR, "Could not open %s: %s", path, strerror(errno));
+		return false;
+	}
+	bool result = true;
+	size_t written = 0;
+	while (written < sb->count) {
+		ssize_t n = write(fd, sb->items + written, sb->count - written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) {
+			nob_log(NOB_ERROR, "Could not write %s: %s", path, strerror(errno));
+			result = false;
+			break;
+		}
+		written += n;
+	}
+	close(fd);
+	return result;
+}
+
+// Appends a name to a string table and returns where it starts
+static Elf64_Word add_name(Nob_String_Builder * names, const char * name)
+{
+	Elf64_Word offset = names->count;
+	nob_sb_append_buf(names, name, strlen(name) + 1);
+	return offset;
+}
+
+uint64_t elfCodeAddress(void)
+{
+	return ELF_BASE_ADDRESS + ELF_HEADERS_SIZE;
+}
+
+// The zeroed memory starts on the page after the code, sharing one would have the kernel map it over the code
+size_t elfReservedOffset(size_t size)
+{
+	return align(ELF_BASE_ADDRESS + ELF_HEADERS_SIZE + size, ELF_PAGE_SIZE) - (ELF_BASE_ADDRESS + ELF_HEADERS_SIZE);
+}
+
+// Only needed for debug info, the loader goes by the program headers alone. The contents of the sections
+// follow the code in the file without being loaded, then come the headers for .text, .bss and them.
+static void append_section_headers(Nob_String_Builder * sb, size_t size, size_t reserved, const ElfDebug * debug)
+{
+	Nob_String_Builder names = {0};
+	nob_sb_append_buf(&names, "", 1);
+	Elf64_Shdr * headers = calloc(debug->sectionCount + 6, sizeof(*headers));
+	assert(headers != NULL && "Buy more RAM lol");
+	size_t index = 1;
+
+	Elf64_Shdr * text = &headers[index++];
+	text->sh_name = add_name(&names, ".text");
+	text->sh_type = SHT_PROGBITS;
+	text->sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+	text->sh_addr = ELF_BASE_ADDRESS + ELF_HEADERS_SIZE;
+	text->sh_offset = ELF_HEADERS_SIZE;
+	text->sh_size = size;
+	text->sh_addralign = 1;
+	if (reserved > 0) {
+		Elf64_Shdr * bss = &headers[index++];
+		bss->sh_name = add_name(&names, ".bss");
+		bss->sh_type = SHT_NOBITS;
+		bss->sh_flags = SHF_ALLOC | SHF_WRITE;
+		bss->sh_addr = ELF_BASE_ADDRESS + ELF_HEADERS_SIZE + elfReservedOffset(size);
+		bss->sh_offset = ELF_HEADERS_SIZE + size;
+		bss->sh_size = reserved;
+		bss->sh_addralign = 16;
+	}
+	for (size_t i = 0; i < debug->sectionCount; i++) {
+		Elf64_Shdr * section = &headers[index++];
+		section->sh_name = add_name(&names, debug->sections[i].name);
+		section->sh_type = SHT_PROGBITS;
+		section->sh_offset = sb->count;
+		section->sh_size = debug->sections[i].size;
+		section->sh_addralign = 1;
+		nob_sb_append_buf(sb, debug->sections[i].data, debug->sections[i].size);
+	}
+	if (debug->symbolCount > 0) {
+		// All of them are global, there is only the null symbol before them
+		Nob_String_Builder symbolNames = {0};
+		nob_sb_append_buf(&symbolNames, "", 1);
+		while (sb->count % 8 != 0) nob_sb_append_buf(sb, "", 1);
+		Elf64_Shdr * symtab = &headers[index++];
+		symtab->sh_name = add_name(&names, ".symtab");
+		symtab->sh_type = SHT_SYMTAB;
+		symtab->sh_link = index;
+		symtab->sh_info = 1;
+		symtab->sh_offset = sb->count;
+		symtab->sh_size = (debug->symbolCount + 1) * sizeof(Elf64_Sym);
+		symtab->sh_addralign = 8;
+		symtab->sh_entsize = sizeof(Elf64_Sym);
+		nob_sb_append_buf(sb, &(Elf64_Sym) {0}, sizeof(Elf64_Sym));
+		for (size_t i = 0; i < debug->symbolCount; i++) {
+			Elf64_Sym sym = {0};
+			sym.st_name = add_name(&symbolNames, debug->symbols[i].name);
+			sym.st_info = ELF64_ST_INFO(STB_GLOBAL, debug->symbols[i].function ? STT_FUNC : STT_OBJECT);
+			sym.st_shndx = 1;
+			sym.st_value = elfCodeAddress() + debug->symbols[i].offset;
+			sym.st_size = debug->symbols[i].size;
+			nob_sb_append_buf(sb, &sym, sizeof(sym));
+		}
+		Elf64_Shdr * strtab = &headers[index++];
+		strtab->sh_name = add_name(&names, ".strtab");
+		strtab->sh_type = SHT_STRTAB;
+		strtab->sh_offset = sb->count;
+		strtab->sh_size = symbolNames.count;
+		strtab->sh_addralign = 1;
+		nob_sb_append_buf(sb, symbolNames.items, symbolNames.count);
+		nob_sb_free(symbolNames);
+	}
+	Elf64_Shdr * shstrtab = &headers[index++];
+	shstrtab->sh_name = add_name(&names, ".shstrtab");
+	shstrtab->sh_type = SHT_STRTAB;
+	shstrtab->sh_offset = sb->count;
+	shstrtab->sh_size = names.count;
+	shstrtab->sh_addralign = 1;
+	nob_sb_append_buf(sb, names.items, names.count);
+
+	while (sb->count % 8 != 0) nob_sb_append_buf(sb, "", 1);
+	Elf64_Ehdr * header = (Elf64_Ehdr *)sb->items;
+	header->e_shoff = sb->count;
+	header->e_shentsize = sizeof(Elf64_Shdr);
+	header->e_shnum = index;
+	header->e_shstrndx = index - 1;
+	nob_sb_append_buf(sb, headers, index * sizeof(*headers));
+	free(headers);
+	nob_sb_free(names);
+}
+
+bool writeElfExecutable(const char * path, const uint8_t * code, size_t size, size_t entry, size_t reserved, const ElfDebug * debug)
+{
+	Elf64_Ehdr header = {0};
+	memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS] = ELFCLASS64;
+	header.e_ident[EI_DATA] = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	header.e_type = ET_EXEC;
+	header.e_machine = EM_X86_64;
+	header.e_version = EV_CURRENT;
+	header.e_entry = ELF_BASE_ADDRESS + ELF_HEADERS_SIZE + entry;
+	header.e_phoff = sizeof(Elf64_Ehdr);
+	header.e_ehsize = sizeof(Elf64_Ehdr);
+	header.e_phentsize = sizeof(Elf64_Phdr);
+	header.e_phnum = reserved > 0 ? 2 : 1;
+
+	// One segment maps the whole file, headers included, which keeps the offsets page congruent for free
+	Elf64_Phdr text = {0};
+	text.p_type = PT_LOAD;
+	text.p_flags = PF_R | PF_X;
+	text.p_offset = 0;
+	text.p_vaddr = ELF_BASE_ADDRESS;
+	text.p_paddr = ELF_BASE_ADDRESS;
+	text.p_filesz = ELF_HEADERS_SIZE + size;
+	text.p_memsz = ELF_HEADERS_SIZE + size;
+	text.p_align = ELF_PAGE_SIZE;
+
+	// Nothing of it is in the file, the kernel hands out zeroed pages for all of it
+	Elf64_Phdr bss = {0};
+	bss.p_type = PT_LOAD;
+	bss.p_flags = PF_R | PF_W;
+	bss.p_offset = 0;
+	bss.p_vaddr = ELF_BASE_ADDRESS + ELF_HEADERS_SIZE + elfReservedOffset(size);
+	bss.p_paddr = bss.p_vaddr;
+	bss.p_filesz = 0;
+	bss.p_memsz = reserved;
+	bss.p_align = ELF_PAGE_SIZE;
+
+	Nob_String_Builder sb = {0};
+	nob_sb_append_buf(&sb, &header, sizeof(header));
+	nob_sb_append_buf(&sb, &text, sizeof(text));
+	nob_sb_append_buf(&sb, &bss, sizeof(bss));
+	nob_sb_append_buf(&sb, code, size);
+	if (debug != NULL) append_section_headers(&sb, size, reserved, debug);
+	bool result = write_file(path, &sb, 0755);
+	nob_sb_free(sb);
+	return result;
+}
+
+enum {
+	SECTION_NULL = 0,
+	SECTION_TEXT,
+	SECTION_NOTE_STACK, // Empty, only says the code doesn't need an executable stack
+	SECTION_SYMTAB,
+	SECTION_STRTAB,
+	SECTION_SHSTRTAB,
+	SECTION_COUNT,
+};
+
+bool writeElfObject(const char * path, const uint8_t * code, size_t size, const ElfSymbol * symbols, size_t count)
+{
+	Nob_String_Builder sectionNames = {0};
+	nob_sb_append_buf(&sectionNames, "", 1);
+	Elf64_Shdr sections[SECTION_COUNT] = {0};
+	sections[SECTION_TEXT].sh_name = add_name(&sectionNames, ".text");
+	sections[SECTION_NOTE_STACK].sh_name = add_name(&sectionNames, ".note.GNU-stack");
+	sections[SECTION_SYMTAB].sh_name = add_name(&sectionNames, ".symtab");
+	sections[SECTION_STRTAB].sh_name = add_name(&sectionNames, ".strtab");
+	sections[SECTION_SHSTRTAB].sh_name = add_name(&sectionNames, ".shstrtab");
+
+	// The null symbol and the one for .text are the only local ones
+	Nob_String_Builder names = {0};
+	nob_sb_append_buf(&names, "", 1);
+	Nob_String_Builder symtab = {0};
+	Elf64_Sym sym = {0};
+	nob_sb_append_buf(&symtab, &sym, sizeof(sym));
+	sym.st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+	sym.st_shndx = SECTION_TEXT;
+	nob_sb_append_buf(&symtab, &sym, sizeof(sym));
+	for (size_t i = 0; i < count; i++) {
+		sym = (Elf64_Sym) {0};
+		sym.st_name = add_name(&names, symbols[i].name);
+		sym.st_info = ELF64_ST_INFO(STB_GLOBAL, symbols[i].function ? STT_FUNC : STT_OBJECT);
+		sym.st_shndx = SECTION_TEXT;
+		sym.st_value = symbols[i].offset;
+		sym.st_size = symbols[i].size;
+		nob_sb_append_buf(&symtab, &sym, sizeof(sym));
+	}
+
+	// Laid out as header, code, symbols, names and section headers, each of them aligned to 16
+	Nob_String_Builder sb = {0};
+	nob_sb_append_buf(&sb, &(Elf64_Ehdr) {0}, sizeof(Elf64_Ehdr));
+	const Nob_String_Builder * contents[SECTION_COUNT] = {0};
+	Nob_String_Builder text = { .items = (char *)code, .count = size };
+	contents[SECTION_TEXT] = &text;
+	contents[SECTION_SYMTAB] = &symtab;
+	contents[SECTION_STRTAB] = &names;
+	contents[SECTION_SHSTRTAB] = &sectionNames;
+	for (size_t i = 0; i < SECTION_COUNT; i++) {
+		while (sb.count % 16 != 0) nob_sb_append_buf(&sb, "", 1);
+		sections[i].sh_offset = i == SECTION_NULL ? 0 : sb.count;
+		if (contents[i] == NULL) continue;
+		nob_sb_append_buf(&sb, contents[i]->items, contents[i]->count);
+		sections[i].sh_size = contents[i]->count;
+	}
+
+	sections[SECTION_TEXT].sh_type = SHT_PROGBITS;
+	sections[SECTION_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+	sections[SECTION_TEXT].sh_addralign = 16;
+	sections[SECTION_NOTE_STACK].sh_type = SHT_PROGBITS;
+	sections[SECTION_NOTE_STACK].sh_addralign = 1;
+	sections[SECTION_SYMTAB].sh_type = SHT_SYMTAB;
+	sections[SECTION_SYMTAB].sh_link = SECTION_STRTAB;
+	sections[SECTION_SYMTAB].sh_info = 2;
+	sections[SECTION_SYMTAB].sh_addralign = 8;
+	sections[SECTION_SYMTAB].sh_entsize = sizeof(Elf64_Sym);
+	sections[SECTION_STRTAB].sh_type = SHT_STRTAB;
+	sections[SECTION_STRTAB].sh_addralign = 1;
+	sections[SECTION_SHSTRTAB].sh_type = SHT_STRTAB;
+	sections[SECTION_SHSTRTAB].sh_addralign = 1;
+
+	while (sb.count % 16 != 0) nob_sb_append_buf(&sb, "", 1);
+	Elf64_Ehdr header = {0};
+	memcpy(header.e_ident, ELFMAG, SELFMAG);
+	header.e_ident[EI_CLASS] = ELFCLASS64;
+	header.e_ident[EI_DATA] = ELFDATA2LSB;
+	header.e_ident[EI_VERSION] = EV_CURRENT;
+	header.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+	header.e_type = ET_REL;
+	header.e_machine = EM_X86_64;
+	header.e_version = EV_CURRENT;
+	header.e_shoff = sb.count;
+	header.e_ehsize = sizeof(Elf64_Ehdr);
+	header.e_shentsize = sizeof(Elf64_Shdr);
+	header.e_shnum = SECTION_COUNT;
+	header.e_shstrndx = SECTION_SHSTRTAB;
+	memcpy(sb.items, &header, sizeof(header));
+	nob_sb_append_buf(&sb, sections, sizeof(sections));
+
+	bool result = write_file(path, &sb, 0644);
+	nob_sb_free(sb);
+	nob_sb_free(symtab);
+	nob_sb_free(names);
+	nob_sb_free(sectionNames);
+	return result;
+}
@@ -0,0 +1,42 @@
+#ifndef _ELF64_H
+#define _ELF64_H
+
+#include "types.h"
+
+// Where the code of an executable gets mapped, the same address ld uses by default
+#define ELF_BASE_ADDRESS 0x400000
+
+// Where the code of an executable starts in memory
+uint64_t elfCodeAddress(void);
+// Where zeroed memory following size bytes of code starts, relative to the code
+size_t elfReservedOffset(size_t size);
+typedef struct {
+	const char * name;
+	const uint8_t * data;
+	size_t size;
+} ElfSection;
+
+typedef struct {
+	const char * name;
+	size_t offset; // Into the code
+	size_t size;
+	bool function; // Otherwise it's data
+} ElfSymbol;
+
+// What an executable carries for debuggers and profilers, none of it is loaded
+typedef struct {
+	const ElfSection * sections;
+	size_t sectionCount;
+	const ElfSymbol * symbols;
+	size_t symbolCount;
+} ElfDebug;
+
+// Writes a static x86-64 Linux executable with the code and, when reserved isn't 0, a writable segment of
+// that many zeroed bytes at elfReservedOffset(size). entry is an offset into code, debug can be NULL.
+bool writeElfExecutable(const char * path, const uint8_t * code, size_t size, size_t entry, size_t reserved, const ElfDebug * debug);
+
+// Writes a relocatable x86-64 object with the code in .text and the symbols global, for linking into C programs.
+// The code can't refer to anything outside of itself, there are no relocations.
+bool writeElfObject(const char * path, const uint8_t * code, size_t size, const ElfSymbol * symbols, size_t count);
+
+#endif // _ELF64_H
@@ -9,6 +9,8 @@ static const char *errorLookup[] = {
     [ERROR_OUT_OF_PLACE_END] = "An 'end' statement can only close an 'if', 'else', or 'do' statement",
     [ERROR_MISSING_DO_AFTER_WHILE] = "A 'do' statement must come immediately after a 'while' statement",
     [ERROR_UNRECOGNIZED_TOKEN] = "Internal error 2",
+    [ERROR_UNBALANCED_BRANCHES] = "The branches of an 'if' leave a different number of items on the stack",
+    [ERROR_LOOP_CHANGES_STACK] = "The body of a 'while' loop has to leave the stack the same size as it found it",
 };
 
 void setError(Error error, const char * string)
@@ -16,6 +18,11 @@ void setError(Error error, const char * string)
     errorLookup[error] = string;
 }
 
+const char * errorMessage(Error error)
+{
+	return errorLookup[error];
+}
+
 void reportError(const char * filePath, size_t lineNum, size_t columnNum, Error error)
 {
 	nob_log(NOB_ERROR, "%s:%zu:%zu: %s", filePath, lineNum, columnNum, errorLookup[error]);
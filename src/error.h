@@ -10,9 +10,12 @@ typedef enum {
     ERROR_OUT_OF_PLACE_END,
     ERROR_MISSING_DO_AFTER_WHILE,
     ERROR_UNRECOGNIZED_TOKEN,
+    ERROR_UNBALANCED_BRANCHES,
+    ERROR_LOOP_CHANGES_STACK,
 } Error;
 
 void setError(Error error, const char * string);
+const char * errorMessage(Error error);
 void reportError(const char * filePath, size_t lineNum, size_t columnNum, Error error);
 
 #endif //_ERROR_H
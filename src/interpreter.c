@@ -1,9 +1,19 @@
 #include "interpreter.h"
 
 #include "error.h"
+#include "verifier.h"
+#include "output.h"
+#include "regvm.h"
+#include "jit.h"
+#include "report.h"
+#include "perfcounters.h"
 #include "nob.h"
 
+#include <signal.h>
+#include <sys/time.h>
+
 static Instruction currentInstruction;
+static OutputBuffer output;
 
 static void doPush(ValueStack * stack, Value v)
 {
@@ -13,6 +23,7 @@ static void doPush(ValueStack * stack, Value v)
 static Value doPop(ValueStack * stack)
 {
 	if (stack->count < 1) {
+		outputFlush(&output);
 		reportError(currentInstruction.token.filePath, currentInstruction.token.lineNum, currentInstruction.token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
 		exit(1);
 	}
@@ -113,7 +124,7 @@ static void doDump(ValueStack * stack)
     Value v = doPop(stack);
 	switch (v.type) {
 	case I32:
-		printf("%d\n", v.i32);
+		outputI32(&output, v.i32);
 		break;
 	default:
 		assert(false && "Unreachable");
@@ -156,7 +167,7 @@ static void doElse(size_t * ip)
 
 static void doEnd(size_t * ip)
 {
-	if (currentInstruction.value.i32) *ip = currentInstruction.value.i32;
+	*ip = currentInstruction.value.i32;
 }
 
 static Value doGt(ValueStack * stack)
@@ -276,7 +287,7 @@ static void interpretInstruction(ValueStack * stack, size_t * ip)
 	if (*ip == originalIp) *ip += 1;
 }
 
-void interpretProgram(InstructionArray * instructions)
+static void interpretSwitch(const InstructionArray * instructions)
 {
 	ValueStack stack = {0};
 	size_t ip = 0;
@@ -286,3 +297,730 @@ void interpretProgram(InstructionArray * instructions)
 	}
 	nob_da_free(stack);
 }
+
+// Labels-as-values are a GNU extension, anything else gets the switch based fallback
+#if defined(__GNUC__) || defined(__clang__)
+#define THREADED_DISPATCH
+#endif
+
+#ifdef THREADED_DISPATCH
+#define HANDLER(opcode) handler_##opcode:
+#define NEXT(next) do { ip = (next); goto *handlers[code[ip].opcode]; } while (0)
+#else
+#define HANDLER(opcode) case opcode:
+#define NEXT(next) do { ip = (next); goto dispatch; } while (0)
+#endif
+
+static void stackUnderflow(const Bytecode * bytecode, size_t ip, size_t component)
+{
+	Token token = bytecodeToken(bytecode, ip, component);
+	outputFlush(&output);
+	reportError(token.filePath, token.lineNum, token.colNum, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK);
+	exit(1);
+}
+
+static Value * growStack(Value ** items, size_t * capacity, Value * sp)
+{
+	size_t count = sp - *items;
+	*capacity *= 2;
+	*items = realloc(*items, *capacity * sizeof(**items));
+	assert(*items != NULL && "Buy more RAM lol");
+	return *items + count;
+}
+
+static int32_t asI32(Value v)
+{
+	switch (v.type) {
+	case I32:
+		return v.i32;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+	return 0;
+}
+
+// Back-edges a loop takes in the interpreter before it gets compiled to native code
+#define TIER_UP_THRESHOLD 1000
+
+typedef struct {
+	size_t backEdges; // SIZE_MAX once compiling failed, so it isn't tried again
+	bool compiled;
+	JitLoop loop;
+} LoopTier;
+
+// Per op state of --vm=tiered, only the ops that close a loop ever use theirs
+static struct {
+	LoopTier * loops;
+	size_t count;
+	int64_t * values;
+	size_t capacity;
+} tiers;
+
+static void tieredDump(int64_t value)
+{
+	outputI32(&output, (int32_t)value);
+}
+
+// Counts a back-edge of the loop closed at ip and returns its native code once it is hot,
+// as long as the stack has enough items for it
+static const JitLoop * hotLoop(const Bytecode * bytecode, size_t ip, size_t depth)
+{
+	LoopTier * tier = &tiers.loops[ip];
+	if (!tier->compiled) {
+		if (tier->backEdges == SIZE_MAX || ++tier->backEdges < TIER_UP_THRESHOLD) return NULL;
+		if (!jitCompileLoop(bytecode->instructions, bytecode->origins.items[ip], tieredDump, &tier->loop)) {
+			tier->backEdges = SIZE_MAX;
+			return NULL;
+		}
+		tier->compiled = true;
+	}
+	return depth >= tier->loop.needed ? &tier->loop : NULL;
+}
+
+static int64_t * loopValues(size_t count)
+{
+	if (count > tiers.capacity) {
+		tiers.capacity = count;
+		tiers.values = realloc(tiers.values, tiers.capacity * sizeof(*tiers.values));
+		assert(tiers.values != NULL && "Buy more RAM lol");
+	}
+	return tiers.values;
+}
+
+#define ENGINE_NAME interpretChecked
+#define ENGINE_CHECKED 1
+#define ENGINE_TAGGED 1
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretVerified
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 1
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretUnboxed
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 0
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretTieredChecked
+#define ENGINE_CHECKED 1
+#define ENGINE_TAGGED 1
+#define ENGINE_TIERED 1
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretTieredUnboxed
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 0
+#define ENGINE_TIERED 1
+#include "dispatch.h"
+
+// Per op state of --profile
+static struct {
+	uint64_t * counts;
+	uint64_t * cycles; // NULL unless the cycles are measured
+	uint64_t last;     // When the op at lastIp started
+	size_t lastIp;     // SIZE_MAX before the first op
+} profile;
+
+// Each op is charged the time up to the start of the next one, dispatch included
+static inline void profileOp(size_t ip)
+{
+	profile.counts[ip] += 1;
+	if (profile.cycles) {
+		uint64_t now = timestamp();
+		if (profile.lastIp != SIZE_MAX) profile.cycles[profile.lastIp] += now - profile.last;
+		profile.last = now;
+		profile.lastIp = ip;
+	}
+}
+
+#define ENGINE_NAME interpretProfiledChecked
+#define ENGINE_CHECKED 1
+#define ENGINE_TAGGED 1
+#define ENGINE_HOOK profileOp
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretProfiledUnboxed
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 0
+#define ENGINE_HOOK profileOp
+#include "dispatch.h"
+
+// State of --sample, the engines only store the ip of the op they are on and SIGPROF reads it from there
+static volatile size_t sampledIp;
+static struct {
+	uint64_t * samples; // One per op and one more for the time before the first op
+	size_t ops;
+} sampling;
+
+#define sampleOp(ip) (sampledIp = (ip))
+
+static void takeSample(int signal)
+{
+	(void)signal;
+	size_t ip = sampledIp;
+	sampling.samples[ip < sampling.ops ? ip : sampling.ops] += 1;
+}
+
+#define ENGINE_NAME interpretSampledChecked
+#define ENGINE_CHECKED 1
+#define ENGINE_TAGGED 1
+#define ENGINE_HOOK sampleOp
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretSampledUnboxed
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 0
+#define ENGINE_HOOK sampleOp
+#include "dispatch.h"
+
+static void interpretThreaded(const Bytecode * bytecode)
+{
+	// Programs with a statically known stack depth everywhere can't underflow and never
+	// need more than maxDepth slots, so they run without any checks on the stack
+	StackEffects effects = {0};
+	if (!verifyStackEffects(bytecode->instructions, &effects, false)) {
+		interpretChecked(bytecode, 16);
+	} else if (inferI32Types(bytecode->instructions, &effects)) {
+		// On top of that when every value is known to be an I32 the tags are dead weight
+		interpretUnboxed(bytecode, effects.maxDepth);
+	} else {
+		interpretVerified(bytecode, effects.maxDepth);
+	}
+	freeStackEffects(&effects);
+}
+
+// Starts out in the threaded interpreter and moves loops that turn out to be hot into native code,
+// the loop is entered at its 'while' with the live items of the stack and hands them back when it exits
+static void interpretTiered(const Bytecode * bytecode)
+{
+	tiers.loops = calloc(bytecode->ops.count, sizeof(*tiers.loops));
+	tiers.count = bytecode->ops.count;
+	assert(tiers.loops != NULL && "Buy more RAM lol");
+
+	StackEffects effects = {0};
+	if (verifyStackEffects(bytecode->instructions, &effects, false) && inferI32Types(bytecode->instructions, &effects)) {
+		interpretTieredUnboxed(bytecode, effects.maxDepth);
+	} else {
+		interpretTieredChecked(bytecode, 16);
+	}
+	freeStackEffects(&effects);
+
+	for (size_t i = 0; i < tiers.count; i++) {
+		jitFreeLoop(&tiers.loops[i].loop);
+	}
+	free(tiers.loops);
+	free(tiers.values);
+	tiers.loops = NULL;
+	tiers.values = NULL;
+	tiers.count = 0;
+	tiers.capacity = 0;
+}
+
+// Runs the engine --vm=threaded would pick with a counter per op, then adds them up per instruction
+static void interpretProfiled(const Bytecode * bytecode, InterpreterOptions options)
+{
+	size_t ops = bytecode->ops.count;
+	profile.counts = calloc(ops, sizeof(*profile.counts));
+	assert(profile.counts != NULL && "Buy more RAM lol");
+	if (options.profileCycles) {
+		profile.cycles = calloc(ops, sizeof(*profile.cycles));
+		assert(profile.cycles != NULL && "Buy more RAM lol");
+		profile.lastIp = SIZE_MAX;
+	}
+
+	StackEffects effects = {0};
+	if (verifyStackEffects(bytecode->instructions, &effects, false) && inferI32Types(bytecode->instructions, &effects)) {
+		interpretProfiledUnboxed(bytecode, effects.maxDepth);
+	} else {
+		interpretProfiledChecked(bytecode, 16);
+	}
+	if (profile.cycles && profile.lastIp != SIZE_MAX) profile.cycles[profile.lastIp] += timestamp() - profile.last;
+	freeStackEffects(&effects);
+	outputFlush(&output);
+
+	// Ops lowered from several instructions are charged to the first one
+	const InstructionArray * instructions = bytecode->instructions;
+	InstructionProfile result = {0};
+	result.counts = calloc(instructions->count + 1, sizeof(*result.counts));
+	assert(result.counts != NULL && "Buy more RAM lol");
+	if (profile.cycles) {
+		result.cycles = calloc(instructions->count + 1, sizeof(*result.cycles));
+		assert(result.cycles != NULL && "Buy more RAM lol");
+	}
+	for (size_t ip = 0; ip < ops; ip++) {
+		size_t origin = bytecode->origins.items[ip];
+		if (origin >= instructions->count) continue;
+		result.counts[origin] += profile.counts[ip];
+		if (profile.cycles) result.cycles[origin] += profile.cycles[ip];
+	}
+	reportProfile(stderr, instructions, &result, options.profile == PROFILE_JSON);
+
+	free(result.counts);
+	free(result.cycles);
+	free(profile.counts);
+	free(profile.cycles);
+	profile.counts = NULL;
+	profile.cycles = NULL;
+}
+
+// --perf-stats only needs the number of ops for its averages
+static uint64_t opsExecuted;
+
+#define countOp(ip) (opsExecuted += 1)
+
+#define ENGINE_NAME interpretCountedChecked
+#define ENGINE_CHECKED 1
+#define ENGINE_TAGGED 1
+#define ENGINE_HOOK countOp
+#include "dispatch.h"
+
+#define ENGINE_NAME interpretCountedUnboxed
+#define ENGINE_CHECKED 0
+#define ENGINE_TAGGED 0
+#define ENGINE_HOOK countOp
+#include "dispatch.h"
+
+// Runs the engine --vm=threaded would pick with the hardware counters on around just the engine
+static void interpretPerfStats(const Bytecode * bytecode)
+{
+	StackEffects effects = {0};
+	bool unboxed = verifyStackEffects(bytecode->instructions, &effects, false) && inferI32Types(bytecode->instructions, &effects);
+	opsExecuted = 0;
+
+	PerfCounters counters = {0};
+	perfCountersStart(&counters);
+	if (unboxed) {
+		interpretCountedUnboxed(bytecode, effects.maxDepth);
+	} else {
+		interpretCountedChecked(bytecode, 16);
+	}
+	perfCountersStop(&counters);
+	freeStackEffects(&effects);
+	outputFlush(&output);
+
+	if (bytecode->instructions->count > 0) fprintf(stderr, "%s: ", bytecode->instructions->items[0].token.filePath);
+	perfCountersReport(stderr, &counters, opsExecuted);
+}
+
+// Runs the engine --vm=threaded would pick while a profiling timer samples which op it is on
+static void interpretSampled(const Bytecode * bytecode, InterpreterOptions options)
+{
+	sampling.ops = bytecode->ops.count;
+	sampling.samples = calloc(sampling.ops + 1, sizeof(*sampling.samples));
+	assert(sampling.samples != NULL && "Buy more RAM lol");
+	sampledIp = SIZE_MAX;
+
+	StackEffects effects = {0};
+	bool unboxed = verifyStackEffects(bytecode->instructions, &effects, false) && inferI32Types(bytecode->instructions, &effects);
+
+	// SA_RESTART so the writes of the output buffer don't see EINTR all the time
+	struct sigaction action = {0};
+	struct sigaction previous = {0};
+	action.sa_handler = takeSample;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, &previous);
+	struct itimerval timer = {0};
+	timer.it_interval.tv_sec = 1 / options.sampleHz;
+	timer.it_interval.tv_usec = options.sampleHz > 1 ? 1000000 / options.sampleHz : 0;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) < 0) {
+		nob_log(NOB_WARNING, "Could not start the profiling timer: %s", strerror(errno));
+	}
+
+	if (unboxed) {
+		interpretSampledUnboxed(bytecode, effects.maxDepth);
+	} else {
+		interpretSampledChecked(bytecode, 16);
+	}
+
+	struct itimerval stop = {0};
+	setitimer(ITIMER_PROF, &stop, NULL);
+	sigaction(SIGPROF, &previous, NULL);
+	freeStackEffects(&effects);
+	outputFlush(&output);
+
+	// A fused op is charged to the instruction it starts with
+	const InstructionArray * instructions = bytecode->instructions;
+	uint64_t * samples = calloc(instructions->count + 1, sizeof(*samples));
+	assert(samples != NULL && "Buy more RAM lol");
+	for (size_t ip = 0; ip < sampling.ops; ip++) {
+		size_t origin = bytecode->origins.items[ip];
+		if (origin < instructions->count) samples[origin] += sampling.samples[ip];
+	}
+	reportSamples(stderr, instructions, samples, sampling.samples[sampling.ops]);
+
+	free(samples);
+	free(sampling.samples);
+	sampling.samples = NULL;
+}
+
+// Same ops as the unboxed engine but the top of the stack lives in a local, so binary
+// operators read a single slot from memory and 'dup N > do' doesn't touch memory at all.
+// Memory holds everything below the top, the first push spills a garbage top into slot 0.
+static void interpretTos(const Bytecode * bytecode, size_t maxDepth)
+{
+	int32_t * stack = malloc((maxDepth + 1) * sizeof(*stack));
+	assert(stack != NULL && "Buy more RAM lol");
+	int32_t * sp = stack;
+	int32_t tos = 0;
+	int32_t a;
+
+	const Op * code = bytecode->ops.items;
+	size_t ip = 0;
+
+#ifdef THREADED_DISPATCH
+	static void * const handlers[OP_COUNT] = {
+		[OP_PUSH] = &&handler_OP_PUSH,
+		[OP_PLUS] = &&handler_OP_PLUS,
+		[OP_MINUS] = &&handler_OP_MINUS,
+		[OP_MULTIPLY] = &&handler_OP_MULTIPLY,
+		[OP_DIVIDE] = &&handler_OP_DIVIDE,
+		[OP_DUMP] = &&handler_OP_DUMP,
+		[OP_EQUAL] = &&handler_OP_EQUAL,
+		[OP_DUP] = &&handler_OP_DUP,
+		[OP_GT] = &&handler_OP_GT,
+		[OP_LT] = &&handler_OP_LT,
+		[OP_JMP] = &&handler_OP_JMP,
+		[OP_JZ] = &&handler_OP_JZ,
+		[OP_HALT] = &&handler_OP_HALT,
+		[OP_PUSH_PLUS] = &&handler_OP_PUSH_PLUS,
+		[OP_PUSH_MINUS] = &&handler_OP_PUSH_MINUS,
+		[OP_PUSH_MULTIPLY] = &&handler_OP_PUSH_MULTIPLY,
+		[OP_PUSH_DIVIDE] = &&handler_OP_PUSH_DIVIDE,
+		[OP_PUSH_EQUAL] = &&handler_OP_PUSH_EQUAL,
+		[OP_PUSH_GT] = &&handler_OP_PUSH_GT,
+		[OP_PUSH_LT] = &&handler_OP_PUSH_LT,
+		[OP_EQUAL_JZ] = &&handler_OP_EQUAL_JZ,
+		[OP_GT_JZ] = &&handler_OP_GT_JZ,
+		[OP_LT_JZ] = &&handler_OP_LT_JZ,
+		[OP_PUSH_EQUAL_JZ] = &&handler_OP_PUSH_EQUAL_JZ,
+		[OP_PUSH_GT_JZ] = &&handler_OP_PUSH_GT_JZ,
+		[OP_PUSH_LT_JZ] = &&handler_OP_PUSH_LT_JZ,
+		[OP_DUP_PUSH_EQUAL] = &&handler_OP_DUP_PUSH_EQUAL,
+		[OP_DUP_PUSH_GT] = &&handler_OP_DUP_PUSH_GT,
+		[OP_DUP_PUSH_LT] = &&handler_OP_DUP_PUSH_LT,
+		[OP_DUP_PUSH_EQUAL_JZ] = &&handler_OP_DUP_PUSH_EQUAL_JZ,
+		[OP_DUP_PUSH_GT_JZ] = &&handler_OP_DUP_PUSH_GT_JZ,
+		[OP_DUP_PUSH_LT_JZ] = &&handler_OP_DUP_PUSH_LT_JZ,
+	};
+
+	NEXT(0);
+#else
+dispatch:
+	switch (code[ip].opcode) {
+#endif
+	HANDLER(OP_PUSH)
+		*sp++ = tos;
+		tos = code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PLUS)
+		a = *--sp;
+		tos = a + tos;
+		NEXT(ip + 1);
+	HANDLER(OP_MINUS)
+		a = *--sp;
+		tos = a - tos;
+		NEXT(ip + 1);
+	HANDLER(OP_MULTIPLY)
+		a = *--sp;
+		tos = a * tos;
+		NEXT(ip + 1);
+	HANDLER(OP_DIVIDE)
+		a = *--sp;
+		tos = a / tos;
+		NEXT(ip + 1);
+	HANDLER(OP_DUMP)
+		outputI32(&output, tos);
+		tos = *--sp;
+		NEXT(ip + 1);
+	HANDLER(OP_EQUAL)
+		a = *--sp;
+		tos = a == tos;
+		NEXT(ip + 1);
+	HANDLER(OP_GT)
+		a = *--sp;
+		tos = a > tos;
+		NEXT(ip + 1);
+	HANDLER(OP_LT)
+		a = *--sp;
+		tos = a < tos;
+		NEXT(ip + 1);
+	HANDLER(OP_JMP)
+		NEXT((size_t)code[ip].operand);
+	HANDLER(OP_JZ)
+		a = tos;
+		tos = *--sp;
+		NEXT(a ? ip + 1 : (size_t)code[ip].operand);
+	HANDLER(OP_DUP)
+		*sp++ = tos;
+		NEXT(ip + 1);
+	HANDLER(OP_HALT)
+		goto halt;
+	HANDLER(OP_PUSH_PLUS)
+		tos = tos + code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_MINUS)
+		tos = tos - code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_MULTIPLY)
+		tos = tos * code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_DIVIDE)
+		tos = tos / code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_EQUAL)
+		tos = tos == code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_GT)
+		tos = tos > code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_PUSH_LT)
+		tos = tos < code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_EQUAL_JZ)
+		a = *--sp == tos;
+		tos = *--sp;
+		NEXT(a ? ip + 1 : (size_t)code[ip].operand);
+	HANDLER(OP_GT_JZ)
+		a = *--sp > tos;
+		tos = *--sp;
+		NEXT(a ? ip + 1 : (size_t)code[ip].operand);
+	HANDLER(OP_LT_JZ)
+		a = *--sp < tos;
+		tos = *--sp;
+		NEXT(a ? ip + 1 : (size_t)code[ip].operand);
+	HANDLER(OP_PUSH_EQUAL_JZ)
+		a = tos == code[ip].operand;
+		tos = *--sp;
+		NEXT(a ? ip + 2 : (size_t)code[ip + 1].operand);
+	HANDLER(OP_PUSH_GT_JZ)
+		a = tos > code[ip].operand;
+		tos = *--sp;
+		NEXT(a ? ip + 2 : (size_t)code[ip + 1].operand);
+	HANDLER(OP_PUSH_LT_JZ)
+		a = tos < code[ip].operand;
+		tos = *--sp;
+		NEXT(a ? ip + 2 : (size_t)code[ip + 1].operand);
+	HANDLER(OP_DUP_PUSH_EQUAL)
+		*sp++ = tos;
+		tos = tos == code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_DUP_PUSH_GT)
+		*sp++ = tos;
+		tos = tos > code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_DUP_PUSH_LT)
+		*sp++ = tos;
+		tos = tos < code[ip].operand;
+		NEXT(ip + 1);
+	HANDLER(OP_DUP_PUSH_EQUAL_JZ)
+		NEXT(tos == code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	HANDLER(OP_DUP_PUSH_GT_JZ)
+		NEXT(tos > code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+	HANDLER(OP_DUP_PUSH_LT_JZ)
+		NEXT(tos < code[ip].operand ? ip + 2 : (size_t)code[ip + 1].operand);
+#ifndef THREADED_DISPATCH
+	default:
+		assert(false && "Unreachable");
+	}
+#endif
+
+halt:
+	free(stack);
+}
+
+static void interpretTosCached(const Bytecode * bytecode)
+{
+	StackEffects effects = {0};
+	if (verifyStackEffects(bytecode->instructions, &effects, false) && inferI32Types(bytecode->instructions, &effects)) {
+		interpretTos(bytecode, effects.maxDepth);
+	} else {
+		nob_log(NOB_WARNING, "--vm=tos needs a statically known stack depth, falling back to --vm=threaded");
+		interpretThreaded(bytecode);
+	}
+	freeStackEffects(&effects);
+}
+
+static void interpretRegisterProgram(const RegisterProgram * program)
+{
+	int32_t * r = calloc(program->registerCount + 1, sizeof(*r));
+	assert(r != NULL && "Buy more RAM lol");
+	const RegOp * code = program->ops.items;
+	size_t ip = 0;
+
+#ifdef THREADED_DISPATCH
+	static void * const handlers[REG_COUNT] = {
+		[REG_LOAD] = &&handler_REG_LOAD,
+		[REG_MOVE] = &&handler_REG_MOVE,
+		[REG_PLUS] = &&handler_REG_PLUS,
+		[REG_MINUS] = &&handler_REG_MINUS,
+		[REG_MULTIPLY] = &&handler_REG_MULTIPLY,
+		[REG_DIVIDE] = &&handler_REG_DIVIDE,
+		[REG_EQUAL] = &&handler_REG_EQUAL,
+		[REG_GT] = &&handler_REG_GT,
+		[REG_LT] = &&handler_REG_LT,
+		[REG_PLUSI] = &&handler_REG_PLUSI,
+		[REG_MINUSI] = &&handler_REG_MINUSI,
+		[REG_MULTIPLYI] = &&handler_REG_MULTIPLYI,
+		[REG_DIVIDEI] = &&handler_REG_DIVIDEI,
+		[REG_EQUALI] = &&handler_REG_EQUALI,
+		[REG_GTI] = &&handler_REG_GTI,
+		[REG_LTI] = &&handler_REG_LTI,
+		[REG_RMINUSI] = &&handler_REG_RMINUSI,
+		[REG_DUMP] = &&handler_REG_DUMP,
+		[REG_DUMPI] = &&handler_REG_DUMPI,
+		[REG_JMP] = &&handler_REG_JMP,
+		[REG_JZ] = &&handler_REG_JZ,
+		[REG_EQUAL_JZ] = &&handler_REG_EQUAL_JZ,
+		[REG_GT_JZ] = &&handler_REG_GT_JZ,
+		[REG_LT_JZ] = &&handler_REG_LT_JZ,
+		[REG_EQUALI_JZ] = &&handler_REG_EQUALI_JZ,
+		[REG_GTI_JZ] = &&handler_REG_GTI_JZ,
+		[REG_LTI_JZ] = &&handler_REG_LTI_JZ,
+		[REG_HALT] = &&handler_REG_HALT,
+	};
+
+	NEXT(0);
+#else
+dispatch:
+	switch (code[ip].opcode) {
+#endif
+	HANDLER(REG_LOAD)
+		r[code[ip].dst] = code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_MOVE)
+		r[code[ip].dst] = r[code[ip].lhs];
+		NEXT(ip + 1);
+	HANDLER(REG_PLUS)
+		r[code[ip].dst] = r[code[ip].lhs] + r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_MINUS)
+		r[code[ip].dst] = r[code[ip].lhs] - r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_MULTIPLY)
+		r[code[ip].dst] = r[code[ip].lhs] * r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_DIVIDE)
+		r[code[ip].dst] = r[code[ip].lhs] / r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_EQUAL)
+		r[code[ip].dst] = r[code[ip].lhs] == r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_GT)
+		r[code[ip].dst] = r[code[ip].lhs] > r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_LT)
+		r[code[ip].dst] = r[code[ip].lhs] < r[code[ip].rhs];
+		NEXT(ip + 1);
+	HANDLER(REG_PLUSI)
+		r[code[ip].dst] = r[code[ip].lhs] + code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_MINUSI)
+		r[code[ip].dst] = r[code[ip].lhs] - code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_MULTIPLYI)
+		r[code[ip].dst] = r[code[ip].lhs] * code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_DIVIDEI)
+		r[code[ip].dst] = r[code[ip].lhs] / code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_EQUALI)
+		r[code[ip].dst] = r[code[ip].lhs] == code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_GTI)
+		r[code[ip].dst] = r[code[ip].lhs] > code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_LTI)
+		r[code[ip].dst] = r[code[ip].lhs] < code[ip].rhs;
+		NEXT(ip + 1);
+	HANDLER(REG_RMINUSI)
+		r[code[ip].dst] = code[ip].rhs - r[code[ip].lhs];
+		NEXT(ip + 1);
+	HANDLER(REG_DUMP)
+		outputI32(&output, r[code[ip].lhs]);
+		NEXT(ip + 1);
+	HANDLER(REG_DUMPI)
+		outputI32(&output, code[ip].rhs);
+		NEXT(ip + 1);
+	HANDLER(REG_JMP)
+		NEXT(code[ip].dst);
+	HANDLER(REG_JZ)
+		NEXT(r[code[ip].lhs] ? ip + 1 : code[ip].dst);
+	HANDLER(REG_EQUAL_JZ)
+		NEXT(r[code[ip].lhs] == r[code[ip].rhs] ? ip + 1 : code[ip].dst);
+	HANDLER(REG_GT_JZ)
+		NEXT(r[code[ip].lhs] > r[code[ip].rhs] ? ip + 1 : code[ip].dst);
+	HANDLER(REG_LT_JZ)
+		NEXT(r[code[ip].lhs] < r[code[ip].rhs] ? ip + 1 : code[ip].dst);
+	HANDLER(REG_EQUALI_JZ)
+		NEXT(r[code[ip].lhs] == code[ip].rhs ? ip + 1 : code[ip].dst);
+	HANDLER(REG_GTI_JZ)
+		NEXT(r[code[ip].lhs] > code[ip].rhs ? ip + 1 : code[ip].dst);
+	HANDLER(REG_LTI_JZ)
+		NEXT(r[code[ip].lhs] < code[ip].rhs ? ip + 1 : code[ip].dst);
+	HANDLER(REG_HALT)
+		goto halt;
+#ifndef THREADED_DISPATCH
+	default:
+		assert(false && "Unreachable");
+	}
+#endif
+
+halt:
+	free(r);
+}
+
+static void interpretRegisters(const Bytecode * bytecode)
+{
+	StackEffects effects = {0};
+	if (verifyStackEffects(bytecode->instructions, &effects, false)) {
+		RegisterProgram program = {0};
+		translateToRegisters(bytecode->instructions, &effects, &program);
+		interpretRegisterProgram(&program);
+		freeRegisterProgram(&program);
+	} else {
+		nob_log(NOB_WARNING, "--vm=reg needs a statically known stack depth, falling back to --vm=threaded");
+		interpretThreaded(bytecode);
+	}
+	freeStackEffects(&effects);
+}
+
+void interpretProgram(const Bytecode * bytecode, InterpreterOptions options)
+{
+	outputInit(&output, STDOUT_FILENO, options.outputCapacity ? options.outputCapacity : OUTPUT_DEFAULT_CAPACITY, options.lineFlush);
+
+	switch (options.profile || options.sampleHz || options.perfStats ? VM_THREADED : options.vm) {
+	case VM_THREADED:
+		if (options.profile) {
+			interpretProfiled(bytecode, options);
+		} else if (options.sampleHz) {
+			interpretSampled(bytecode, options);
+		} else if (options.perfStats) {
+			interpretPerfStats(bytecode);
+		} else {
+			interpretThreaded(bytecode);
+		}
+		break;
+	case VM_SWITCH:
+		interpretSwitch(bytecode->instructions);
+		break;
+	case VM_TOS:
+		interpretTosCached(bytecode);
+		break;
+	case VM_REG:
+		interpretRegisters(bytecode);
+		break;
+	case VM_TIERED:
+		interpretTiered(bytecode);
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+
+	outputFlush(&output);
+	outputFree(&output);
+}
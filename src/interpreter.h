@@ -2,7 +2,38 @@
 #define _INTERPRETER_H
 
 #include "types.h"
+#include "bytecode.h"
 
-void interpretProgram(InstructionArray * instructions);
+typedef enum {
+	VM_THREADED = 0,
+	VM_SWITCH,
+	VM_TOS,
+	VM_REG,
+	VM_TIERED,
+} VirtualMachine;
+
+typedef enum {
+	PROFILE_OFF = 0,
+	PROFILE_TEXT,
+	PROFILE_JSON,
+} ProfileFormat;
+
+typedef struct {
+	VirtualMachine vm;
+	// Counts how often every op runs in the threaded interpreter and reports it by line and instruction type on stderr
+	// at exit. Leave the ops unfused so each of them is one instruction.
+	ProfileFormat profile;
+	bool profileCycles; // Times every op with the time stamp counter on top, which costs a lot more
+	// Samples the op the threaded interpreter is on this many times per second of CPU time instead, and reports the
+	// samples by line on stderr and as folded stacks for flame graphs in <name>.folded. 0 for off.
+	unsigned sampleHz;
+	// Counts cycles, instructions, branch misses and L1D misses of the threaded interpreter with perf_event_open and
+	// reports them per op on stderr, only the time stamp counter where the kernel doesn't allow that
+	bool perfStats;
+	size_t outputCapacity; // 0 picks OUTPUT_DEFAULT_CAPACITY
+	bool lineFlush;
+} InterpreterOptions;
+
+void interpretProgram(const Bytecode * bytecode, InterpreterOptions options);
 
 #endif // _INTERPRETER_H
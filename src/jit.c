@@ -0,0 +1,230 @@
+#include "jit.h"
+
+#include "compiler.h"
+#include "verifier.h"
+#include "x86.h"
+#include "nob.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// The program runs on the native stack, keep well clear of the default 8MB limit
+#define JIT_MAX_DEPTH (256*1024)
+
+typedef void (*JitEntry)(void);
+typedef size_t (*JitLoopEntry)(int64_t * values, size_t count);
+
+static const Assembler * sortedAssembler;
+
+static int compareLabelOffsets(const void * a, const void * b)
+{
+	size_t x = sortedAssembler->labels.items[*(const size_t *)a].offset;
+	size_t y = sortedAssembler->labels.items[*(const size_t *)b].offset;
+	return (x > y) - (x < y);
+}
+
+// perf picks up symbols for anonymous executable memory from /tmp/perf-<pid>.map,
+// instructions are named after their place in the source so samples land on a line
+static void writePerfMap(const Assembler * a, uintptr_t base, const InstructionArray * instructions, size_t firstLabel, size_t first, size_t last)
+{
+	const char * path = nob_temp_sprintf("/tmp/perf-%d.map", getpid());
+	FILE * map = fopen(path, "a");
+	if (map == NULL) {
+		nob_log(NOB_WARNING, "Could not write %s: %s", path, strerror(errno));
+		return;
+	}
+
+	size_t * order = malloc(a->labels.count * sizeof(*order));
+	assert(order != NULL && "Buy more RAM lol");
+	size_t count = 0;
+	for (size_t i = 0; i < a->labels.count; i++) {
+		if (a->labels.items[i].bound) order[count++] = i;
+	}
+	sortedAssembler = a;
+	qsort(order, count, sizeof(*order), compareLabelOffsets);
+
+	// Each label covers the code up to the next one, empty ranges like a while marker are skipped
+	for (size_t i = 0; i < count; i++) {
+		size_t start = a->labels.items[order[i]].offset;
+		size_t end = i + 1 < count ? a->labels.items[order[i + 1]].offset : a->code.count;
+		if (end == start) continue;
+		size_t ip = order[i] - firstLabel;
+		if (ip >= first && ip <= last && ip < instructions->count) {
+			Token token = instructions->items[ip].token;
+			fprintf(map, "%lx %zx minos %s:%zu:%zu\n", (unsigned long)(base + start), end - start, token.filePath, token.lineNum, token.colNum);
+		} else {
+			fprintf(map, "%lx %zx minos %s\n", (unsigned long)(base + start), end - start, a->labels.items[order[i]].name);
+		}
+	}
+	free(order);
+	fclose(map);
+}
+
+// The generated code keeps values in every callee saved register and uses rbp for the base of its stack
+static const Register calleeSaved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+static void saveRegisters(Assembler * a)
+{
+	for (size_t i = 0; i < NOB_ARRAY_LEN(calleeSaved); i++) {
+		asmOp1(a, MN_PUSH, r64(calleeSaved[i]));
+	}
+}
+
+static void restoreRegisters(Assembler * a)
+{
+	for (size_t i = NOB_ARRAY_LEN(calleeSaved); i > 0; i--) {
+		asmOp1(a, MN_POP, r64(calleeSaved[i - 1]));
+	}
+}
+
+// The value to dump is already in rdi, it only has to reach C with an aligned stack
+static void compileCallDump(Assembler * a, size_t dump, JitDumpFn dumpFn)
+{
+	asmBind(a, dump);
+	asmOp1(a, MN_PUSH, r64(RBX));
+	asmOp2(a, MN_MOV, r64(RBX), r64(RSP));
+	asmOp2(a, MN_AND, r64(RSP), imm(-16));
+	asmOp2(a, MN_MOV, r64(RAX), imm((int64_t)(uintptr_t)dumpFn));
+	asmOp1(a, MN_CALL, r64(RAX));
+	asmOp2(a, MN_MOV, r64(RSP), r64(RBX));
+	asmOp1(a, MN_POP, r64(RBX));
+	asmOp0(a, MN_RET);
+}
+
+// Copies the code into fresh pages that are never writable and executable at the same time
+static void * mapCode(const Assembler * a)
+{
+	void * code = mmap(NULL, a->code.count, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (code == MAP_FAILED) {
+		nob_log(NOB_ERROR, "Could not map memory for the generated code: %s", strerror(errno));
+		exit(1);
+	}
+	memcpy(code, a->code.items, a->code.count);
+	if (mprotect(code, a->code.count, PROT_READ | PROT_EXEC) != 0) {
+		nob_log(NOB_ERROR, "Could not make the generated code executable: %s", strerror(errno));
+		exit(1);
+	}
+	return code;
+}
+
+bool jitProgram(const InstructionArray * instructions, JitDumpFn dumpFn)
+{
+	StackEffects effects = {0};
+	if (!verifyStackEffects(instructions, &effects, false) || effects.maxDepth > JIT_MAX_DEPTH) {
+		freeStackEffects(&effects);
+		return false;
+	}
+
+	Assembler a;
+	asmInit(&a, NULL);
+	size_t entry = asmNewLabel(&a, ".ENTRY");
+	size_t dump = asmNewLabel(&a, ".dump");
+	size_t firstLabel = newInstructionLabels(&a, 0, instructions->count);
+
+	// Called from C, so keep the callee saved registers and remember where the stack started
+	asmBind(&a, entry);
+	saveRegisters(&a);
+	asmOp2(&a, MN_MOV, r64(RBP), r64(RSP));
+	compileInstructions(&a, instructions, 0, instructions->count, firstLabel, dump, effects.depths, NULL, NULL);
+	freeStackEffects(&effects);
+	asmOp2(&a, MN_MOV, r64(RSP), r64(RBP));
+	restoreRegisters(&a);
+	asmOp0(&a, MN_RET);
+	compileCallDump(&a, dump, dumpFn);
+	asmResolve(&a);
+
+	void * code = mapCode(&a);
+	size_t size = a.code.count;
+	writePerfMap(&a, (uintptr_t)code, instructions, firstLabel, 0, instructions->count);
+	asmFree(&a);
+
+	JitEntry run;
+	memcpy(&run, &code, sizeof(run));
+	run();
+
+	munmap(code, size);
+	return true;
+}
+
+bool jitCompileLoop(const InstructionArray * instructions, size_t endIp, JitDumpFn dumpFn, JitLoop * loop)
+{
+	*loop = (JitLoop) {0};
+	size_t whileIp = instructions->items[endIp].value.i32;
+	StackEffects effects = {0};
+	if (!verifyLoop(instructions, endIp, &effects) || effects.maxDepth > JIT_MAX_DEPTH) {
+		freeStackEffects(&effects);
+		return false;
+	}
+	loop->needed = effects.depths[whileIp];
+	loop->growth = effects.maxDepth - loop->needed;
+
+	Assembler a;
+	asmInit(&a, NULL);
+	size_t entry = asmNewLabel(&a, ".LOOP");
+	size_t dump = asmNewLabel(&a, ".dump");
+	size_t copyIn = asmNewLabel(&a, ".copyIn");
+	size_t copyInCheck = asmNewLabel(&a, ".copyInCheck");
+	size_t copyOut = asmNewLabel(&a, ".copyOut");
+	size_t done = asmNewLabel(&a, ".done");
+	size_t firstLabel = newInstructionLabels(&a, whileIp, endIp + 1);
+
+	// size_t loop(int64_t * values, size_t count), values[count - 1] being the top of the stack.
+	// values is kept right above the native stack of the loop, at [rbp].
+	asmBind(&a, entry);
+	saveRegisters(&a);
+	asmOp1(&a, MN_PUSH, r64(RDI));
+	asmOp2(&a, MN_MOV, r64(RBP), r64(RSP));
+	asmOp2(&a, MN_XOR, r32(RCX), r32(RCX));
+	asmJmp(&a, copyInCheck);
+	asmBind(&a, copyIn);
+	asmOp1(&a, MN_PUSH, memIndex(8, RDI, RCX, 8, 0));
+	asmOp1(&a, MN_INC, r64(RCX));
+	asmBind(&a, copyInCheck);
+	asmOp2(&a, MN_CMP, r64(RCX), r64(RSI));
+	asmJcc(&a, CC_B, copyIn);
+
+	// Leaving the loop lands on .INSTRUCTION_<end + 1>, from there whatever is on the native stack goes back into values and its count is returned
+	compileInstructions(&a, instructions, whileIp, endIp + 1, firstLabel, dump, effects.depths, NULL, NULL);
+	freeStackEffects(&effects);
+	asmOp2(&a, MN_MOV, r64(RDI), mem(8, RBP, 0));
+	asmOp2(&a, MN_MOV, r64(RAX), r64(RBP));
+	asmOp2(&a, MN_SUB, r64(RAX), r64(RSP));
+	asmOp2(&a, MN_SHR, r64(RAX), imm(3));
+	asmOp2(&a, MN_MOV, r64(RDX), r64(RBP));
+	asmOp2(&a, MN_XOR, r32(RCX), r32(RCX));
+	asmBind(&a, copyOut);
+	asmOp2(&a, MN_CMP, r64(RCX), r64(RAX));
+	asmJcc(&a, CC_AE, done);
+	asmOp2(&a, MN_SUB, r64(RDX), imm(8));
+	asmOp2(&a, MN_MOV, r64(R8), mem(8, RDX, 0));
+	asmOp2(&a, MN_MOV, memIndex(8, RDI, RCX, 8, 0), r64(R8));
+	asmOp1(&a, MN_INC, r64(RCX));
+	asmJmp(&a, copyOut);
+	asmBind(&a, done);
+	asmOp2(&a, MN_MOV, r64(RSP), r64(RBP));
+	asmOp1(&a, MN_POP, r64(RDI));
+	restoreRegisters(&a);
+	asmOp0(&a, MN_RET);
+
+	compileCallDump(&a, dump, dumpFn);
+	asmResolve(&a);
+
+	loop->code = mapCode(&a);
+	loop->size = a.code.count;
+	writePerfMap(&a, (uintptr_t)loop->code, instructions, firstLabel, whileIp, endIp);
+	asmFree(&a);
+	return true;
+}
+
+size_t jitRunLoop(const JitLoop * loop, int64_t * values, size_t count)
+{
+	JitLoopEntry run;
+	memcpy(&run, &loop->code, sizeof(run));
+	return run(values, count);
+}
+
+void jitFreeLoop(JitLoop * loop)
+{
+	if (loop->code) munmap(loop->code, loop->size);
+	*loop = (JitLoop) {0};
+}
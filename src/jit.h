@@ -0,0 +1,28 @@
+#ifndef _JIT_H
+#define _JIT_H
+
+#include "types.h"
+
+// Called by the generated code for every dump with the sign extended int32
+typedef void (*JitDumpFn)(int64_t value);
+
+// Compiles the program to machine code in memory and runs it.
+// Returns false without running anything when the stack depth can't be proven safe for the native stack.
+bool jitProgram(const InstructionArray * instructions, JitDumpFn dump);
+
+typedef struct {
+	void * code;
+	size_t size;
+	size_t needed; // Items below the loop's entry depth it reads, they have to be passed in
+	size_t growth; // How many items it can have above those at most
+} JitLoop;
+
+// Compiles the 'while' loop closed by the 'end' at endIp so a running interpreter can hand it over,
+// false when the loop on its own doesn't have a known stack effect
+bool jitCompileLoop(const InstructionArray * instructions, size_t endIp, JitDumpFn dump, JitLoop * loop);
+// Runs the loop from its 'while' with the top count items of the stack in values, which needs room for
+// needed + growth items. The items left when the loop exits are written back and their count is returned.
+size_t jitRunLoop(const JitLoop * loop, int64_t * values, size_t count);
+void jitFreeLoop(JitLoop * loop);
+
+#endif // _JIT_H
@@ -3,35 +3,124 @@
 
 #include "types.h"
 #include "linter.h"
+#include "bytecode.h"
 #include "interpreter.h"
 #include "compiler.h"
+#include "jit.h"
+#include "cache.h"
+#include "output.h"
+#include "report.h"
+
+static OutputBuffer jitOutput;
+
+static void jitDump(int64_t value)
+{
+	outputI32(&jitOutput, (int32_t)value);
+}
+
+static void runUsage(const char * program)
+{
+	nob_log(NOB_INFO, "Usage: %s run [--vm=threaded|switch|tos|reg|tiered] [--output-buffer=<bytes>] [--line-buffered|--full-buffered] [--profile[=json]] [--profile-cycles] [--sample=<hz>] [--perf-stats] <file>", program);
+}
+
+static void compileUsage(const char * program)
+{
+	nob_log(NOB_INFO, "Usage: %s compile [--backend=native|c] [--asm=builtin|nasm] [--emit=exe|obj] [-g] [--instrument] [--no-cache] [--prune-cache[=<days>]] <files...>", program);
+}
 
 int main(int argc, char** argv)
 {
 	const char * program = nob_shift_args(&argc, &argv);
 	
 	if (argc < 1) {
-		nob_log(NOB_INFO, "Usage: %s <run/compile> <args>", program);
+		nob_log(NOB_INFO, "Usage: %s <run/compile/jit/report> <args>", program);
 		nob_log(NOB_ERROR, "No subcommand is provided");
 		return 1;
 	}
 	const char * subcommand = nob_shift_args(&argc, &argv);
 
 	if (strcmp(subcommand, "run") == 0) {
-		if (argc < 1) {
-			nob_log(NOB_INFO, "Usage: %s <run/compile> <args>", program);
+		InterpreterOptions options = {0};
+		// Like stdio, flush every line when a person is watching the output
+		options.lineFlush = isatty(STDOUT_FILENO);
+		const char * filepath = NULL;
+		while (argc > 0) {
+			const char * arg = nob_shift_args(&argc, &argv);
+			if (strcmp(arg, "--vm=threaded") == 0) {
+				options.vm = VM_THREADED;
+			} else if (strcmp(arg, "--vm=switch") == 0) {
+				options.vm = VM_SWITCH;
+			} else if (strcmp(arg, "--vm=tos") == 0) {
+				options.vm = VM_TOS;
+			} else if (strcmp(arg, "--vm=reg") == 0) {
+				options.vm = VM_REG;
+			} else if (strcmp(arg, "--vm=tiered") == 0) {
+				options.vm = VM_TIERED;
+			} else if (strncmp(arg, "--output-buffer=", 16) == 0) {
+				char * end;
+				options.outputCapacity = strtoull(arg + 16, &end, 10);
+				if (*end != '\0' || options.outputCapacity == 0 || options.outputCapacity > OUTPUT_MAX_CAPACITY) {
+					runUsage(program);
+					nob_log(NOB_ERROR, "Invalid output buffer size in %s, it has to be from 1 to %d bytes", arg, OUTPUT_MAX_CAPACITY);
+					return 1;
+				}
+			} else if (strcmp(arg, "--profile") == 0) {
+				options.profile = PROFILE_TEXT;
+			} else if (strcmp(arg, "--profile=json") == 0) {
+				options.profile = PROFILE_JSON;
+			} else if (strcmp(arg, "--profile-cycles") == 0) {
+				options.profileCycles = true;
+			} else if (strncmp(arg, "--sample=", 9) == 0) {
+				char * end;
+				unsigned long long hz = strtoull(arg + 9, &end, 10);
+				if (*end != '\0' || hz == 0 || hz > 1000000) {
+					runUsage(program);
+					nob_log(NOB_ERROR, "Invalid sampling rate in %s, it has to be from 1 to 1000000", arg);
+					return 1;
+				}
+				options.sampleHz = hz;
+			} else if (strcmp(arg, "--perf-stats") == 0) {
+				options.perfStats = true;
+			} else if (strcmp(arg, "--line-buffered") == 0) {
+				options.lineFlush = true;
+			} else if (strcmp(arg, "--full-buffered") == 0) {
+				options.lineFlush = false;
+			} else if (arg[0] == '-') {
+				runUsage(program);
+				nob_log(NOB_ERROR, "Unknown flag %s", arg);
+				return 1;
+			} else {
+				filepath = arg;
+			}
+		}
+		if (options.profileCycles && !options.profile) options.profile = PROFILE_TEXT;
+		if ((options.profile != PROFILE_OFF) + (options.sampleHz > 0) + options.perfStats > 1) {
+			runUsage(program);
+			nob_log(NOB_ERROR, "Only one of --profile, --sample and --perf-stats can be used at a time");
+			return 1;
+		}
+		if ((options.profile || options.sampleHz || options.perfStats) && options.vm != VM_THREADED) {
+			nob_log(NOB_WARNING, "%s always runs on the threaded interpreter",
+				options.profile ? "--profile" : options.sampleHz ? "--sample" : "--perf-stats");
+		}
+		if (filepath == NULL) {
+			nob_log(NOB_INFO, "Usage: %s <run/compile/jit/report> <args>", program);
 			nob_log(NOB_ERROR, "No input file path is provided");
 			return 1;
 		}
-		const char * filepath = nob_shift_args(&argc, &argv);
 
 		InstructionArray instructions = {0};
 		if (!lintInstructionsFromFile(filepath, &instructions)) return 1;
-		interpretProgram(&instructions);
+		Bytecode bytecode = {0};
+		lowerInstructions(&instructions, &bytecode);
+		// Unfused every op is a single instruction, so the profile can tell them apart
+		if (!options.profile) fuseSuperinstructions(&bytecode);
+		interpretProgram(&bytecode, options);
+		freeBytecode(&bytecode);
 		nob_da_free(instructions);
-	} else if (strcmp(subcommand, "compile") == 0) {
+	} else if (strcmp(subcommand, "jit") == 0) {
 		if (argc < 1) {
-			nob_log(NOB_INFO, "Usage: %s <run/compile> <args>", program);
+			nob_log(NOB_INFO, "Usage: %s <run/compile/jit/report> <args>", program);
 			nob_log(NOB_ERROR, "No input file path is provided");
 			return 1;
 		}
@@ -39,10 +128,100 @@ int main(int argc, char** argv)
 
 		InstructionArray instructions = {0};
 		if (!lintInstructionsFromFile(filepath, &instructions)) return 1;
-		compileProgram(&instructions, filepath);
+		outputInit(&jitOutput, STDOUT_FILENO, OUTPUT_DEFAULT_CAPACITY, isatty(STDOUT_FILENO));
+		bool jitted = jitProgram(&instructions, jitDump);
+		outputFlush(&jitOutput);
+		outputFree(&jitOutput);
+		if (!jitted) {
+			nob_log(NOB_WARNING, "jit needs a statically known stack depth, falling back to the interpreter");
+			Bytecode bytecode = {0};
+			lowerInstructions(&instructions, &bytecode);
+			fuseSuperinstructions(&bytecode);
+			InterpreterOptions options = {0};
+			options.lineFlush = isatty(STDOUT_FILENO);
+			interpretProgram(&bytecode, options);
+			freeBytecode(&bytecode);
+		}
 		nob_da_free(instructions);
+	} else if (strcmp(subcommand, "compile") == 0) {
+		CompilerOptions options = {0};
+		Nob_File_Paths filepaths = {0};
+		bool prune = false;
+		uint64_t maxAgeDays = CACHE_DEFAULT_MAX_AGE_DAYS;
+		while (argc > 0) {
+			const char * arg = nob_shift_args(&argc, &argv);
+			if (strcmp(arg, "--asm=nasm") == 0) {
+				options.nasm = true;
+			} else if (strcmp(arg, "--asm=builtin") == 0) {
+				options.nasm = false;
+			} else if (strcmp(arg, "--backend=native") == 0) {
+				options.backend = BACKEND_NATIVE;
+			} else if (strcmp(arg, "--backend=c") == 0) {
+				options.backend = BACKEND_C;
+			} else if (strcmp(arg, "--emit=exe") == 0) {
+				options.emit = EMIT_EXECUTABLE;
+			} else if (strcmp(arg, "--emit=obj") == 0) {
+				options.emit = EMIT_OBJECT;
+			} else if (strcmp(arg, "--instrument") == 0) {
+				options.instrument = true;
+			} else if (strcmp(arg, "-g") == 0) {
+				options.debug = true;
+			} else if (strcmp(arg, "--no-cache") == 0) {
+				options.noCache = true;
+			} else if (strcmp(arg, "--prune-cache") == 0) {
+				prune = true;
+			} else if (strncmp(arg, "--prune-cache=", 14) == 0) {
+				char * end = NULL;
+				maxAgeDays = strtoull(arg + 14, &end, 10);
+				if (*end != '\0' || end == arg + 14) {
+					compileUsage(program);
+					nob_log(NOB_ERROR, "Invalid number of days in %s", arg);
+					return 1;
+				}
+				prune = true;
+			} else if (arg[0] == '-') {
+				compileUsage(program);
+				nob_log(NOB_ERROR, "Unknown flag %s", arg);
+				return 1;
+			} else {
+				nob_da_append(&filepaths, arg);
+			}
+		}
+		if (options.backend == BACKEND_C && options.emit == EMIT_OBJECT) {
+			compileUsage(program);
+			nob_log(NOB_ERROR, "--emit=obj only works with --backend=native");
+			return 1;
+		}
+		if (options.debug && options.emit == EMIT_OBJECT && !options.nasm) {
+			compileUsage(program);
+			nob_log(NOB_ERROR, "-g with --emit=obj only works with --asm=nasm");
+			return 1;
+		}
+		if (options.instrument && (options.backend != BACKEND_NATIVE || options.emit != EMIT_EXECUTABLE)) {
+			compileUsage(program);
+			nob_log(NOB_ERROR, "--instrument only works for native executables");
+			return 1;
+		}
+		if (prune && !cachePrune(maxAgeDays)) return 1;
+		if (prune && filepaths.count == 0) return 0;
+		if (filepaths.count == 0) {
+			nob_log(NOB_INFO, "Usage: %s <run/compile/jit/report> <args>", program);
+			nob_log(NOB_ERROR, "No input file path is provided");
+			return 1;
+		}
+
+		bool compiled = compileFiles(filepaths.items, filepaths.count, options);
+		nob_da_free(filepaths);
+		if (!compiled) return 1;
+	} else if (strcmp(subcommand, "report") == 0) {
+		if (argc < 1) {
+			nob_log(NOB_INFO, "Usage: %s report <file.counts>", program);
+			nob_log(NOB_ERROR, "No counts file is provided");
+			return 1;
+		}
+		if (!reportCounts(nob_shift_args(&argc, &argv))) return 1;
 	} else {
-		nob_log(NOB_INFO, "Usage: %s <run/compile> <args>", program);
+		nob_log(NOB_INFO, "Usage: %s <run/compile/jit/report> <args>", program);
 		nob_log(NOB_ERROR, "Invalid subcommand provided");
 		return 1;
 	} 
@@ -0,0 +1,77 @@
+#include "output.h"
+
+#include "nob.h"
+#include <unistd.h>
+
+static const char digitPairs[201] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+void outputInit(OutputBuffer * output, int fd, size_t capacity, bool lineFlush)
+{
+	if (capacity < OUTPUT_MAX_LINE) capacity = OUTPUT_MAX_LINE;
+	output->items = malloc(capacity);
+	assert(output->items != NULL && "Buy more RAM lol");
+	output->count = 0;
+	output->capacity = capacity;
+	output->lineFlush = lineFlush;
+	output->fd = fd;
+}
+
+void outputI32(OutputBuffer * output, int32_t n)
+{
+	if (output->capacity - output->count < OUTPUT_MAX_LINE) outputFlush(output);
+
+	// Digits are produced back to front, two at a time, into a scratch buffer
+	char digits[OUTPUT_MAX_LINE];
+	char * p = digits + sizeof(digits);
+	*--p = '\n';
+	uint32_t magnitude = n < 0 ? 0u - (uint32_t)n : (uint32_t)n;
+	while (magnitude >= 100) {
+		uint32_t pair = magnitude % 100;
+		magnitude /= 100;
+		p -= 2;
+		memcpy(p, &digitPairs[pair * 2], 2);
+	}
+	if (magnitude >= 10) {
+		p -= 2;
+		memcpy(p, &digitPairs[magnitude * 2], 2);
+	} else {
+		*--p = (char)('0' + magnitude);
+	}
+	if (n < 0) *--p = '-';
+
+	size_t length = digits + sizeof(digits) - p;
+	memcpy(output->items + output->count, p, length);
+	output->count += length;
+	if (output->lineFlush) outputFlush(output);
+}
+
+void outputFlush(OutputBuffer * output)
+{
+	size_t written = 0;
+	while (written < output->count) {
+		ssize_t n = write(output->fd, output->items + written, output->count - written);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			nob_log(NOB_ERROR, "Could not write program output: %s", strerror(errno));
+			break;
+		}
+		written += n;
+	}
+	output->count = 0;
+}
+
+void outputFree(OutputBuffer * output)
+{
+	free(output->items);
+	*output = (OutputBuffer) {0};
+}
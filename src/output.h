@@ -0,0 +1,25 @@
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include "types.h"
+
+#define OUTPUT_DEFAULT_CAPACITY (64*1024)
+// Largest buffer --output-buffer asks for, past this a bigger buffer saves no more writes worth having
+#define OUTPUT_MAX_CAPACITY (1024*1024*1024)
+// Longest line outputI32 can produce, "-2147483648\n"
+#define OUTPUT_MAX_LINE 12
+
+typedef struct {
+	char * items;
+	size_t count;
+	size_t capacity;
+	bool lineFlush; // Flush after every line, for interactive use
+	int fd;
+} OutputBuffer;
+
+void outputInit(OutputBuffer * output, int fd, size_t capacity, bool lineFlush);
+void outputI32(OutputBuffer * output, int32_t n);
+void outputFlush(OutputBuffer * output);
+void outputFree(OutputBuffer * output);
+
+#endif // _OUTPUT_H
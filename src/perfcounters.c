@@ -0,0 +1,103 @@
+#include "perfcounters.h"
+
+#include "nob.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+	const char * name;
+	uint32_t type;
+	uint64_t config;
+} counterEvents[COUNTER_COUNT] = {
+	[COUNTER_CYCLES] = { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[COUNTER_INSTRUCTIONS] = { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[COUNTER_BRANCH_MISSES] = { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[COUNTER_L1D_MISSES] = { "L1D-load-misses", PERF_TYPE_HW_CACHE,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+void perfCountersStart(PerfCounters * counters)
+{
+	for (size_t i = 0; i < COUNTER_COUNT; i++) {
+		struct perf_event_attr attr = {0};
+		attr.size = sizeof(attr);
+		attr.type = counterEvents[i].type;
+		attr.config = counterEvents[i].config;
+		attr.disabled = 1;
+		// Kernel and hypervisor counting need more privileges than perf_event_paranoid usually gives
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		counters->fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		counters->errors[i] = counters->fds[i] < 0 ? errno : 0;
+		counters->values[i] = 0;
+		counters->scaled[i] = false;
+	}
+	for (size_t i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] >= 0) ioctl(counters->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	counters->start = timestamp();
+}
+
+void perfCountersStop(PerfCounters * counters)
+{
+	counters->ticks = timestamp() - counters->start;
+	for (size_t i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] >= 0) ioctl(counters->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+	for (size_t i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] < 0) continue;
+		// value, time enabled, time running
+		uint64_t readValues[3] = {0};
+		if (read(counters->fds[i], readValues, sizeof(readValues)) != sizeof(readValues)) {
+			counters->errors[i] = errno;
+		} else if (readValues[2] == 0) {
+			counters->errors[i] = EBUSY;
+		} else {
+			counters->values[i] = readValues[0];
+			// More counters than the PMU has take turns, extrapolate to the whole run like perf stat
+			if (readValues[2] < readValues[1]) {
+				counters->values[i] = (uint64_t)((double)readValues[0] * readValues[1] / readValues[2]);
+				counters->scaled[i] = true;
+			}
+		}
+		close(counters->fds[i]);
+		if (counters->errors[i] != 0) counters->fds[i] = -1;
+	}
+}
+
+static const char * refusal(int error)
+{
+	switch (error) {
+	case ENOENT:
+	case EOPNOTSUPP:
+		return "no such counter on this CPU, or not passed through to this VM";
+	case EACCES:
+	case EPERM:
+		return "not allowed, see /proc/sys/kernel/perf_event_paranoid";
+	default:
+		return strerror(error);
+	}
+}
+
+void perfCountersReport(FILE * out, const PerfCounters * counters, uint64_t ops)
+{
+	fprintf(out, "%llu ops interpreted\n", (unsigned long long)ops);
+	bool any = false;
+	for (size_t i = 0; i < COUNTER_COUNT; i++) {
+		if (counters->fds[i] < 0) {
+			fprintf(out, "%16s   %-16s (%s)\n", "not counted", counterEvents[i].name, refusal(counters->errors[i]));
+			continue;
+		}
+		any = true;
+		fprintf(out, "%16llu   %-16s %8.2f per op%s\n", (unsigned long long)counters->values[i], counterEvents[i].name,
+			ops ? (double)counters->values[i] / ops : 0.0, counters->scaled[i] ? "  (scaled)" : "");
+	}
+	if (counters->fds[COUNTER_CYCLES] >= 0 && counters->fds[COUNTER_INSTRUCTIONS] >= 0 && counters->values[COUNTER_CYCLES] > 0) {
+		fprintf(out, "%16.2f   IPC\n", (double)counters->values[COUNTER_INSTRUCTIONS] / counters->values[COUNTER_CYCLES]);
+	}
+	if (!any) fprintf(out, "The kernel refused the hardware counters, timing with the time stamp counter only\n");
+	fprintf(out, "%16llu   %-16s %8.2f per op\n", (unsigned long long)counters->ticks, "TSC ticks", ops ? (double)counters->ticks / ops : 0.0);
+}
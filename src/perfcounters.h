@@ -0,0 +1,48 @@
+#ifndef _PERFCOUNTERS_H
+#define _PERFCOUNTERS_H
+
+#include "types.h"
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+typedef enum {
+	COUNTER_CYCLES = 0,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_BRANCH_MISSES,
+	COUNTER_L1D_MISSES,
+	COUNTER_COUNT,
+} PerfCounter;
+
+typedef struct {
+	int fds[COUNTER_COUNT];       // -1 where the kernel refused the counter
+	int errors[COUNTER_COUNT];    // errno of the refusal
+	uint64_t values[COUNTER_COUNT];
+	bool scaled[COUNTER_COUNT];   // Shared the hardware with other counters and was extrapolated
+	uint64_t start;
+	uint64_t ticks;               // Time stamp counter ticks between start and stop, counted either way
+} PerfCounters;
+
+// The time stamp counter, or nanoseconds where there is none
+static inline uint64_t timestamp(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// Opens the hardware counters for this thread, in user space only, and starts them
+void perfCountersStart(PerfCounters * counters);
+void perfCountersStop(PerfCounters * counters);
+// Prints the counters, their averages over ops interpreted and IPC, or only the ticks when the kernel refused them all
+void perfCountersReport(FILE * out, const PerfCounters * counters, uint64_t ops);
+
+#endif // _PERFCOUNTERS_H
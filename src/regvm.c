@@ -0,0 +1,334 @@
+#include "regvm.h"
+
+#include "nob.h"
+
+typedef enum {
+	SLOT_REGISTER, // The value lives in its own register
+	SLOT_CONSTANT, // Not materialized yet, the value is known at translation time
+	SLOT_ALIAS,    // Not materialized yet, the value is a copy of a register deeper in the stack
+} SlotKind;
+
+typedef struct {
+	SlotKind kind;
+	uint32_t reg;
+	int32_t value;
+} Slot;
+
+typedef struct {
+	RegisterProgram * program;
+	Slot * slots;
+	size_t depth;
+	size_t * labels; // Instruction index to the index of its first register op
+	IndexStack fixups; // Jumps whose dst still holds an instruction index
+} Translator;
+
+static const RegOpCode registerOps[] = {
+	[TOK_PLUS] = REG_PLUS,
+	[TOK_MINUS] = REG_MINUS,
+	[TOK_MULTIPLY] = REG_MULTIPLY,
+	[TOK_DIVIDE] = REG_DIVIDE,
+	[TOK_EQUAL] = REG_EQUAL,
+	[TOK_GT] = REG_GT,
+	[TOK_LT] = REG_LT,
+};
+
+static const RegOpCode immediateOps[] = {
+	[TOK_PLUS] = REG_PLUSI,
+	[TOK_MINUS] = REG_MINUSI,
+	[TOK_MULTIPLY] = REG_MULTIPLYI,
+	[TOK_DIVIDE] = REG_DIVIDEI,
+	[TOK_EQUAL] = REG_EQUALI,
+	[TOK_GT] = REG_GTI,
+	[TOK_LT] = REG_LTI,
+};
+
+static const RegOpCode registerBranches[] = {
+	[TOK_EQUAL] = REG_EQUAL_JZ,
+	[TOK_GT] = REG_GT_JZ,
+	[TOK_LT] = REG_LT_JZ,
+};
+
+static const RegOpCode immediateBranches[] = {
+	[TOK_EQUAL] = REG_EQUALI_JZ,
+	[TOK_GT] = REG_GTI_JZ,
+	[TOK_LT] = REG_LTI_JZ,
+};
+
+// 'constant op x' rewritten as 'x op constant'
+static const TokenType swappedCompares[] = {
+	[TOK_EQUAL] = TOK_EQUAL,
+	[TOK_GT] = TOK_LT,
+	[TOK_LT] = TOK_GT,
+};
+
+static bool isCompare(TokenType type)
+{
+	return type == TOK_EQUAL || type == TOK_GT || type == TOK_LT;
+}
+
+static bool isBinary(TokenType type)
+{
+	return type == TOK_PLUS || type == TOK_MINUS || type == TOK_MULTIPLY || type == TOK_DIVIDE || isCompare(type);
+}
+
+// Same wrap around results as the interpreter, division that would trap is left for runtime
+static bool foldBinary(TokenType type, int32_t a, int32_t b, int32_t * result)
+{
+	switch (type) {
+	case TOK_PLUS: *result = (int32_t)((uint32_t)a + (uint32_t)b); return true;
+	case TOK_MINUS: *result = (int32_t)((uint32_t)a - (uint32_t)b); return true;
+	case TOK_MULTIPLY: *result = (int32_t)((uint32_t)a * (uint32_t)b); return true;
+	case TOK_DIVIDE:
+		if (b == 0 || (a == INT32_MIN && b == -1)) return false;
+		*result = a / b;
+		return true;
+	case TOK_EQUAL: *result = a == b; return true;
+	case TOK_GT: *result = a > b; return true;
+	case TOK_LT: *result = a < b; return true;
+	default:
+		assert(false && "Unreachable");
+		return false;
+	}
+}
+
+static void emit(Translator * t, RegOpCode opcode, uint32_t dst, uint32_t lhs, int32_t rhs)
+{
+	RegOp op = {0};
+	op.opcode = opcode;
+	op.dst = dst;
+	op.lhs = lhs;
+	op.rhs = rhs;
+	nob_da_append(&t->program->ops, op);
+}
+
+static void emitJump(Translator * t, RegOpCode opcode, uint32_t lhs, int32_t rhs, size_t target)
+{
+	nob_da_append(&t->fixups, t->program->ops.count);
+	emit(t, opcode, (uint32_t)target, lhs, rhs);
+}
+
+static void push(Translator * t, Slot slot)
+{
+	t->slots[t->depth++] = slot;
+}
+
+static Slot pop(Translator * t)
+{
+	assert(t->depth > 0);
+	return t->slots[--t->depth];
+}
+
+static Slot inRegister(size_t index)
+{
+	Slot slot = {0};
+	slot.kind = SLOT_REGISTER;
+	slot.reg = (uint32_t)index;
+	return slot;
+}
+
+static Slot constant(int32_t value)
+{
+	Slot slot = {0};
+	slot.kind = SLOT_CONSTANT;
+	slot.value = value;
+	return slot;
+}
+
+static void materialize(Translator * t, size_t index)
+{
+	Slot slot = t->slots[index];
+	switch (slot.kind) {
+	case SLOT_REGISTER:
+		return;
+	case SLOT_CONSTANT:
+		emit(t, REG_LOAD, (uint32_t)index, 0, slot.value);
+		break;
+	case SLOT_ALIAS:
+		emit(t, REG_MOVE, (uint32_t)index, slot.reg, 0);
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+	t->slots[index] = inRegister(index);
+}
+
+// Control flow merges expect every slot to sit in its own register
+static void flush(Translator * t)
+{
+	for (size_t i = 0; i < t->depth; i++) {
+		materialize(t, i);
+	}
+}
+
+static void translateBinary(Translator * t, TokenType type)
+{
+	Slot b = pop(t);
+	Slot a = pop(t);
+	uint32_t dst = (uint32_t)t->depth;
+	int32_t result;
+
+	if (a.kind == SLOT_CONSTANT && b.kind == SLOT_CONSTANT && foldBinary(type, a.value, b.value, &result)) {
+		push(t, constant(result));
+		return;
+	}
+	if (a.kind == SLOT_CONSTANT && b.kind != SLOT_CONSTANT && (isCompare(type) || type == TOK_PLUS || type == TOK_MULTIPLY)) {
+		type = isCompare(type) ? swappedCompares[type] : type;
+		emit(t, immediateOps[type], dst, b.reg, a.value);
+	} else if (a.kind == SLOT_CONSTANT && b.kind != SLOT_CONSTANT && type == TOK_MINUS) {
+		emit(t, REG_RMINUSI, dst, b.reg, a.value);
+	} else {
+		if (a.kind == SLOT_CONSTANT) {
+			t->slots[dst] = a;
+			materialize(t, dst);
+			a = t->slots[dst];
+		}
+		if (b.kind == SLOT_CONSTANT) {
+			emit(t, immediateOps[type], dst, a.reg, b.value);
+		} else {
+			emit(t, registerOps[type], dst, a.reg, b.reg);
+		}
+	}
+	push(t, inRegister(dst));
+}
+
+// Branches to target when the comparison is false, the stack is flushed first since both sides merge somewhere
+static void translateCompareBranch(Translator * t, TokenType type, size_t target)
+{
+	Slot b = pop(t);
+	Slot a = pop(t);
+	flush(t);
+
+	int32_t result;
+	if (a.kind == SLOT_CONSTANT && b.kind == SLOT_CONSTANT) {
+		foldBinary(type, a.value, b.value, &result);
+		if (!result) emitJump(t, REG_JMP, 0, 0, target);
+	} else if (b.kind == SLOT_CONSTANT) {
+		emitJump(t, immediateBranches[type], a.reg, b.value, target);
+	} else if (a.kind == SLOT_CONSTANT) {
+		emitJump(t, immediateBranches[swappedCompares[type]], b.reg, a.value, target);
+	} else {
+		emitJump(t, registerBranches[type], a.reg, b.reg, target);
+	}
+}
+
+static void translateBranch(Translator * t, size_t target)
+{
+	Slot condition = pop(t);
+	flush(t);
+	if (condition.kind == SLOT_CONSTANT) {
+		if (!condition.value) emitJump(t, REG_JMP, 0, 0, target);
+	} else {
+		emitJump(t, REG_JZ, condition.reg, 0, target);
+	}
+}
+
+static bool isConditional(TokenType type)
+{
+	return type == TOK_IF || type == TOK_DO;
+}
+
+void translateToRegisters(const InstructionArray * instructions, const StackEffects * effects, RegisterProgram * program)
+{
+	size_t count = instructions->count;
+	Translator t = {0};
+	t.program = program;
+	t.slots = malloc((effects->maxDepth + 1) * sizeof(*t.slots));
+	t.labels = malloc((count + 1) * sizeof(*t.labels));
+	bool * isTarget = calloc(count + 1, sizeof(*isTarget));
+	assert(t.slots != NULL && t.labels != NULL && isTarget != NULL && "Buy more RAM lol");
+	program->registerCount = effects->maxDepth;
+
+	for (size_t i = 0; i < count; i++) {
+		switch (instructions->items[i].token.type) {
+		case TOK_IF:
+		case TOK_ELSE:
+		case TOK_END:
+		case TOK_DO:
+			isTarget[instructions->items[i].value.i32] = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	for (size_t i = 0; i < count; i++) {
+		Instruction instruction = instructions->items[i];
+		if (isTarget[i]) flush(&t);
+		t.labels[i] = program->ops.count;
+		if (effects->depths[i] == UNKNOWN_DEPTH) continue;
+		if (isTarget[i]) {
+			// Everything that jumps here flushed as well, whatever fell through doesn't matter
+			t.depth = effects->depths[i];
+			for (size_t j = 0; j < t.depth; j++) {
+				t.slots[j] = inRegister(j);
+			}
+		}
+		assert(t.depth == effects->depths[i]);
+
+		switch (instruction.token.type) {
+		case TOK_PUSH:
+			push(&t, constant(instruction.value.i32));
+			break;
+		case TOK_DUP: {
+			Slot top = t.slots[t.depth - 1];
+			if (top.kind == SLOT_REGISTER) top.kind = SLOT_ALIAS;
+			push(&t, top);
+			break;
+		}
+		case TOK_DUMP: {
+			Slot value = pop(&t);
+			if (value.kind == SLOT_CONSTANT) {
+				emit(&t, REG_DUMPI, 0, 0, value.value);
+			} else {
+				emit(&t, REG_DUMP, 0, value.reg, 0);
+			}
+			break;
+		}
+		case TOK_IF:
+		case TOK_DO:
+			translateBranch(&t, instruction.value.i32);
+			break;
+		case TOK_ELSE:
+			flush(&t);
+			emitJump(&t, REG_JMP, 0, 0, instruction.value.i32);
+			break;
+		case TOK_END:
+			if ((size_t)instruction.value.i32 <= i) {
+				flush(&t);
+				emitJump(&t, REG_JMP, 0, 0, instruction.value.i32);
+			}
+			break;
+		case TOK_WHILE:
+			break;
+		default:
+			assert(isBinary(instruction.token.type));
+			if (isCompare(instruction.token.type) && i + 1 < count && isConditional(instructions->items[i + 1].token.type) && !isTarget[i + 1]) {
+				// '= if' becomes a single compare and branch
+				translateCompareBranch(&t, instruction.token.type, instructions->items[i + 1].value.i32);
+				t.labels[++i] = program->ops.count;
+			} else {
+				translateBinary(&t, instruction.token.type);
+			}
+			break;
+		}
+	}
+	t.labels[count] = program->ops.count;
+	emit(&t, REG_HALT, 0, 0, 0);
+
+	for (size_t i = 0; i < t.fixups.count; i++) {
+		RegOp * op = &program->ops.items[t.fixups.items[i]];
+		op->dst = (uint32_t)t.labels[op->dst];
+	}
+
+	free(t.slots);
+	free(t.labels);
+	free(isTarget);
+	nob_da_free(t.fixups);
+}
+
+void freeRegisterProgram(RegisterProgram * program)
+{
+	nob_da_free(program->ops);
+	*program = (RegisterProgram) {0};
+}
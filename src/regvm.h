@@ -0,0 +1,62 @@
+#ifndef _REGVM_H
+#define _REGVM_H
+
+#include "types.h"
+#include "verifier.h"
+
+// Three-address code where register i is the stack slot at depth i
+typedef enum {
+	REG_LOAD = 0, // r[dst] = rhs
+	REG_MOVE,     // r[dst] = r[lhs]
+	REG_PLUS,     // r[dst] = r[lhs] op r[rhs]
+	REG_MINUS,
+	REG_MULTIPLY,
+	REG_DIVIDE,
+	REG_EQUAL,
+	REG_GT,
+	REG_LT,
+	REG_PLUSI,    // r[dst] = r[lhs] op rhs
+	REG_MINUSI,
+	REG_MULTIPLYI,
+	REG_DIVIDEI,
+	REG_EQUALI,
+	REG_GTI,
+	REG_LTI,
+	REG_RMINUSI,  // r[dst] = rhs - r[lhs]
+	REG_DUMP,     // dump r[lhs]
+	REG_DUMPI,    // dump rhs
+	REG_JMP,      // goto dst
+	REG_JZ,       // if (!r[lhs]) goto dst
+	REG_EQUAL_JZ, // if (!(r[lhs] op r[rhs])) goto dst
+	REG_GT_JZ,
+	REG_LT_JZ,
+	REG_EQUALI_JZ, // if (!(r[lhs] op rhs)) goto dst
+	REG_GTI_JZ,
+	REG_LTI_JZ,
+	REG_HALT,
+	REG_COUNT,
+} RegOpCode;
+
+typedef struct {
+	uint32_t dst;
+	uint32_t lhs;
+	int32_t rhs;
+	uint8_t opcode;
+} RegOp;
+
+typedef struct {
+	RegOp * items;
+	size_t count;
+	size_t capacity;
+} RegOpArray;
+
+typedef struct {
+	RegOpArray ops;
+	size_t registerCount;
+} RegisterProgram;
+
+// The effects have to come from a successful verifyStackEffects
+void translateToRegisters(const InstructionArray * instructions, const StackEffects * effects, RegisterProgram * program);
+void freeRegisterProgram(RegisterProgram * program);
+
+#endif // _REGVM_H
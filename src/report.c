@@ -0,0 +1,346 @@
+#include "report.h"
+
+#include "compiler.h"
+#include "linter.h"
+#include "nob.h"
+
+bool reportLines(FILE * out, const InstructionArray * instructions, const uint64_t * counts)
+{
+	if (instructions->count == 0) return true;
+	const char * filePath = instructions->items[0].token.filePath;
+	Nob_String_Builder source = {0};
+	if (!nob_read_entire_file(filePath, &source)) return false;
+
+	size_t lineCount = 1;
+	for (size_t i = 0; i < source.count; i++) {
+		if (source.items[i] == '\n') lineCount += 1;
+	}
+	uint64_t * lineCounts = calloc(lineCount + 1, sizeof(*lineCounts));
+	bool * hasCode = calloc(lineCount + 1, sizeof(*hasCode));
+	assert(lineCounts != NULL && hasCode != NULL && "Buy more RAM lol");
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		size_t line = instructions->items[ip].token.lineNum;
+		if (line > lineCount) continue;
+		hasCode[line] = true;
+		if (counts[ip] > lineCounts[line]) lineCounts[line] = counts[ip];
+	}
+
+	// Laid out like gcov, lines without code get a dash
+	fprintf(out, "%12s | %5s | %s\n", "count", "line", filePath);
+	Nob_String_View rest = nob_sb_to_sv(source);
+	for (size_t line = 1; line <= lineCount && rest.count > 0; line++) {
+		Nob_String_View text = nob_sv_chop_by_delim(&rest, '\n');
+		if (hasCode[line]) {
+			fprintf(out, "%12llu | %5zu | "SV_Fmt"\n", (unsigned long long)lineCounts[line], line, SV_Arg(text));
+		} else {
+			fprintf(out, "%12s | %5zu | "SV_Fmt"\n", "-", line, SV_Arg(text));
+		}
+	}
+	free(lineCounts);
+	free(hasCode);
+	nob_sb_free(source);
+	return true;
+}
+
+bool reportCounts(const char * countsPath)
+{
+	Nob_String_Builder file = {0};
+	if (!nob_read_entire_file(countsPath, &file)) return false;
+	bool result = false;
+	InstructionArray instructions = {0};
+	size_t * blockOf = NULL;
+	uint64_t * counts = NULL;
+
+	// The header is a line of "minos-counts 1 <blocks> <source path>"
+	Nob_String_View rest = nob_sb_to_sv(file);
+	Nob_String_View header = nob_sv_chop_by_delim(&rest, '\n');
+	const char * magic = COUNTS_MAGIC " ";
+	if (!nob_sv_starts_with(header, nob_sv_from_cstr(magic))) {
+		nob_log(NOB_ERROR, "%s is not a counts file of this version of minos", countsPath);
+		goto defer;
+	}
+	header = nob_sv_from_parts(header.data + strlen(magic), header.count - strlen(magic));
+	Nob_String_View number = nob_sv_chop_by_delim(&header, ' ');
+	char * end = NULL;
+	const char * digits = nob_temp_sv_to_cstr(number);
+	size_t blocks = strtoull(digits, &end, 10);
+	if (*digits == '\0' || *end != '\0' || header.count == 0) {
+		nob_log(NOB_ERROR, "%s has a broken header", countsPath);
+		goto defer;
+	}
+	if (rest.count != blocks * 8) {
+		nob_log(NOB_ERROR, "%s should have %zu counters but has %zu bytes of them", countsPath, blocks, rest.count);
+		goto defer;
+	}
+
+	const char * sourcePath = nob_temp_sv_to_cstr(header);
+	if (!lintInstructionsFromFile(sourcePath, &instructions)) goto defer;
+	blockOf = malloc((instructions.count + 1) * sizeof(*blockOf));
+	counts = malloc((instructions.count + 1) * sizeof(*counts));
+	assert(blockOf != NULL && counts != NULL && "Buy more RAM lol");
+	if (findBasicBlocks(&instructions, blockOf) != blocks) {
+		nob_log(NOB_ERROR, "%s changed since the executable that wrote %s was compiled", sourcePath, countsPath);
+		goto defer;
+	}
+
+	uint64_t executions = 0;
+	for (size_t ip = 0; ip < instructions.count; ip++) {
+		const uint8_t * counter = (const uint8_t *)rest.data + blockOf[ip] * 8;
+		counts[ip] = 0;
+		for (size_t i = 0; i < 8; i++) counts[ip] |= (uint64_t)counter[i] << (8 * i);
+		executions += counts[ip];
+	}
+	printf("%s: %zu instructions ran %llu times in total\n", sourcePath, instructions.count, (unsigned long long)executions);
+	result = reportLines(stdout, &instructions, counts);
+
+defer:
+	free(blockOf);
+	free(counts);
+	nob_da_free(instructions);
+	nob_sb_free(file);
+	return result;
+}
+
+typedef struct {
+	uint64_t count;
+	uint64_t cycles;
+} ProfileTotal;
+
+static void printJsonString(FILE * out, const char * s)
+{
+	fputc('"', out);
+	for (; *s != '\0'; s++) {
+		if (*s == '"' || *s == '\\') {
+			fprintf(out, "\\%c", *s);
+		} else if ((unsigned char)*s < 0x20) {
+			fprintf(out, "\\u%04x", *s);
+		} else {
+			fputc(*s, out);
+		}
+	}
+	fputc('"', out);
+}
+
+static void printProfileJson(FILE * out, const InstructionArray * instructions, const InstructionProfile * profile,
+	const ProfileTotal * lines, size_t lineCount, const ProfileTotal * types, size_t typeCount)
+{
+	fprintf(out, "{\"file\":");
+	printJsonString(out, instructions->items[0].token.filePath);
+	fprintf(out, ",\"cycles\":%s,\"instructions\":[", profile->cycles ? "true" : "false");
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		Token token = instructions->items[ip].token;
+		fprintf(out, "%s\n{\"ip\":%zu,\"line\":%zu,\"column\":%zu,\"type\":", ip ? "," : "", ip, token.lineNum, token.colNum);
+		printJsonString(out, tokenTypeName(token.type));
+		fprintf(out, ",\"count\":%llu", (unsigned long long)profile->counts[ip]);
+		if (profile->cycles) fprintf(out, ",\"cycles\":%llu", (unsigned long long)profile->cycles[ip]);
+		fprintf(out, "}");
+	}
+	fprintf(out, "],\"lines\":[");
+	bool first = true;
+	for (size_t line = 1; line <= lineCount; line++) {
+		if (lines[line].count == 0) continue;
+		fprintf(out, "%s\n{\"line\":%zu,\"count\":%llu", first ? "" : ",", line, (unsigned long long)lines[line].count);
+		if (profile->cycles) fprintf(out, ",\"cycles\":%llu", (unsigned long long)lines[line].cycles);
+		fprintf(out, "}");
+		first = false;
+	}
+	fprintf(out, "],\"types\":[");
+	first = true;
+	for (size_t type = 0; type < typeCount; type++) {
+		if (types[type].count == 0) continue;
+		fprintf(out, "%s\n{\"type\":", first ? "" : ",");
+		printJsonString(out, tokenTypeName(type));
+		fprintf(out, ",\"count\":%llu", (unsigned long long)types[type].count);
+		if (profile->cycles) fprintf(out, ",\"cycles\":%llu", (unsigned long long)types[type].cycles);
+		fprintf(out, "}");
+		first = false;
+	}
+	fprintf(out, "]}\n");
+}
+
+bool reportProfile(FILE * out, const InstructionArray * instructions, const InstructionProfile * profile, bool json)
+{
+	if (instructions->count == 0) return true;
+	size_t lineCount = 0;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		if (instructions->items[ip].token.lineNum > lineCount) lineCount = instructions->items[ip].token.lineNum;
+	}
+	ProfileTotal * lines = calloc(lineCount + 1, sizeof(*lines));
+	assert(lines != NULL && "Buy more RAM lol");
+	ProfileTotal types[TOK_LT + 1] = {0};
+	uint64_t executions = 0;
+	uint64_t cycles = 0;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		Token token = instructions->items[ip].token;
+		uint64_t spent = profile->cycles ? profile->cycles[ip] : 0;
+		lines[token.lineNum].count += profile->counts[ip];
+		lines[token.lineNum].cycles += spent;
+		types[token.type].count += profile->counts[ip];
+		types[token.type].cycles += spent;
+		executions += profile->counts[ip];
+		cycles += spent;
+	}
+
+	if (json) {
+		printProfileJson(out, instructions, profile, lines, lineCount, types, NOB_ARRAY_LEN(types));
+		free(lines);
+		return true;
+	}
+
+	// Unlike reportLines a line adds up all of its instructions, so the totals are instructions executed
+	fprintf(out, "%s: %llu instructions executed", instructions->items[0].token.filePath, (unsigned long long)executions);
+	if (profile->cycles) fprintf(out, " in %llu cycles", (unsigned long long)cycles);
+	fprintf(out, "\n\n%12s %12s %8s | %5s\n", "count", "cycles", "cyc/op", "line");
+	for (size_t line = 1; line <= lineCount; line++) {
+		if (lines[line].count == 0) continue;
+		if (profile->cycles) {
+			fprintf(out, "%12llu %12llu %8.1f | %5zu\n", (unsigned long long)lines[line].count,
+				(unsigned long long)lines[line].cycles, (double)lines[line].cycles / lines[line].count, line);
+		} else {
+			fprintf(out, "%12llu %12s %8s | %5zu\n", (unsigned long long)lines[line].count, "-", "-", line);
+		}
+	}
+	fprintf(out, "\n%12s %12s %8s | %s\n", "count", "cycles", "cyc/op", "instruction");
+	for (size_t type = 0; type < NOB_ARRAY_LEN(types); type++) {
+		if (types[type].count == 0) continue;
+		if (profile->cycles) {
+			fprintf(out, "%12llu %12llu %8.1f | %s\n", (unsigned long long)types[type].count,
+				(unsigned long long)types[type].cycles, (double)types[type].cycles / types[type].count, tokenTypeName(type));
+		} else {
+			fprintf(out, "%12llu %12s %8s | %s\n", (unsigned long long)types[type].count, "-", "-", tokenTypeName(type));
+		}
+	}
+	free(lines);
+	return true;
+}
+
+typedef struct {
+	char * stack;
+	uint64_t samples;
+} FoldedStack;
+
+static int compareFolded(const void * a, const void * b)
+{
+	return strcmp(((const FoldedStack *)a)->stack, ((const FoldedStack *)b)->stack);
+}
+
+// Flame graph tools split frames on ';' and the count off at the last space
+static void appendFrame(Nob_String_Builder * sb, const char * frame)
+{
+	if (sb->count > 0) nob_da_append(sb, ';');
+	for (; *frame != '\0'; frame++) nob_da_append(sb, *frame == ';' ? '_' : *frame);
+}
+
+static bool writeFolded(const char * path, const InstructionArray * instructions, const uint64_t * samples, uint64_t outside)
+{
+	const char * filePath = instructions->items[0].token.filePath;
+	// loopOf is the innermost loop an instruction is in, as the index of its 'while', parentOf the loop around that
+	size_t * loopOf = malloc(instructions->count * sizeof(*loopOf));
+	size_t * parentOf = malloc(instructions->count * sizeof(*parentOf));
+	assert(loopOf != NULL && parentOf != NULL && "Buy more RAM lol");
+	size_t loop = SIZE_MAX;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		Instruction instruction = instructions->items[ip];
+		if (instruction.token.type == TOK_WHILE) {
+			parentOf[ip] = loop;
+			loop = ip;
+		}
+		loopOf[ip] = loop;
+		// The 'end' of a loop jumps back to its 'while'
+		if (instruction.token.type == TOK_END && (size_t)instruction.value.i32 <= ip) loop = parentOf[instruction.value.i32];
+	}
+
+	struct {
+		FoldedStack * items;
+		size_t count;
+		size_t capacity;
+	} stacks = {0};
+	Nob_String_Builder sb = {0};
+	if (outside > 0) {
+		appendFrame(&sb, filePath);
+		appendFrame(&sb, "startup");
+		nob_sb_append_null(&sb);
+		FoldedStack stack = { strdup(sb.items), outside };
+		nob_da_append(&stacks, stack);
+	}
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		if (samples[ip] == 0) continue;
+		// Outermost loop first, like callers in a call stack
+		size_t loops[64];
+		size_t depth = 0;
+		for (size_t l = loopOf[ip]; l != SIZE_MAX && depth < NOB_ARRAY_LEN(loops); l = parentOf[l]) loops[depth++] = l;
+		sb.count = 0;
+		appendFrame(&sb, filePath);
+		while (depth > 0) {
+			Token token = instructions->items[loops[--depth]].token;
+			appendFrame(&sb, nob_temp_sprintf("while %zu:%zu", token.lineNum, token.colNum));
+		}
+		appendFrame(&sb, nob_temp_sprintf("line %zu", instructions->items[ip].token.lineNum));
+		nob_sb_append_null(&sb);
+		FoldedStack stack = { strdup(sb.items), samples[ip] };
+		assert(stack.stack != NULL && "Buy more RAM lol");
+		nob_da_append(&stacks, stack);
+	}
+	nob_sb_free(sb);
+	free(loopOf);
+	free(parentOf);
+
+	// Instructions of the same line in the same loop make one stack
+	bool result = true;
+	FILE * file = fopen(path, "w");
+	if (file == NULL) {
+		nob_log(NOB_ERROR, "Could not open %s: %s", path, strerror(errno));
+		result = false;
+	}
+	if (stacks.count > 0) qsort(stacks.items, stacks.count, sizeof(*stacks.items), compareFolded);
+	for (size_t i = 0; i < stacks.count; i++) {
+		uint64_t total = stacks.items[i].samples;
+		while (i + 1 < stacks.count && strcmp(stacks.items[i].stack, stacks.items[i + 1].stack) == 0) {
+			free(stacks.items[i].stack);
+			total += stacks.items[++i].samples;
+		}
+		if (file != NULL) fprintf(file, "%s %llu\n", stacks.items[i].stack, (unsigned long long)total);
+		free(stacks.items[i].stack);
+	}
+	nob_da_free(stacks);
+	if (file != NULL && fclose(file) != 0) {
+		nob_log(NOB_ERROR, "Could not write %s: %s", path, strerror(errno));
+		result = false;
+	}
+	return result;
+}
+
+bool reportSamples(FILE * out, const InstructionArray * instructions, const uint64_t * samples, uint64_t outside)
+{
+	if (instructions->count == 0) return true;
+	const char * filePath = instructions->items[0].token.filePath;
+	size_t lineCount = 0;
+	uint64_t total = outside;
+	for (size_t ip = 0; ip < instructions->count; ip++) {
+		if (instructions->items[ip].token.lineNum > lineCount) lineCount = instructions->items[ip].token.lineNum;
+		total += samples[ip];
+	}
+	uint64_t * lines = calloc(lineCount + 1, sizeof(*lines));
+	assert(lines != NULL && "Buy more RAM lol");
+	for (size_t ip = 0; ip < instructions->count; ip++) lines[instructions->items[ip].token.lineNum] += samples[ip];
+
+	fprintf(out, "%s: %llu samples\n", filePath, (unsigned long long)total);
+	if (total > 0) {
+		fprintf(out, "\n%12s %7s | %5s\n", "samples", "%", "line");
+		for (size_t line = 1; line <= lineCount; line++) {
+			if (lines[line] == 0) continue;
+			fprintf(out, "%12llu %6.2f%% | %5zu\n", (unsigned long long)lines[line], 100.0 * lines[line] / total, line);
+		}
+	}
+	free(lines);
+	// Too short a run to be sampled, an earlier profile in the working directory is worth more than an empty one
+	if (total == 0) return true;
+
+	const char * name = nob_path_name(filePath);
+	const char * dot = strrchr(name, '.');
+	int stem = dot != NULL && dot != name ? (int)(dot - name) : (int)strlen(name);
+	const char * path = nob_temp_sprintf("%.*s.folded", stem, name);
+	if (!writeFolded(path, instructions, samples, outside)) return false;
+	fprintf(out, "\nFolded stacks are in %s\n", path);
+	return true;
+}
@@ -0,0 +1,24 @@
+#ifndef _REPORT_H
+#define _REPORT_H
+
+#include "types.h"
+#include <stdio.h>
+
+// Prints the source of the program next to how often each line ran, counts has one entry per instruction.
+// A line counts as often as the instruction on it that ran the most.
+bool reportLines(FILE * out, const InstructionArray * instructions, const uint64_t * counts);
+typedef struct {
+	uint64_t * counts; // One per instruction
+	uint64_t * cycles; // One per instruction, NULL when they weren't measured
+} InstructionProfile;
+
+// Prints how often every line and every kind of instruction ran, as a table or as JSON
+bool reportProfile(FILE * out, const InstructionArray * instructions, const InstructionProfile * profile, bool json);
+// Prints which lines the samples of a sampling run landed on and writes them as folded stacks to <name>.folded in the
+// working directory, with the enclosing loops as the callers of a line. samples has one entry per instruction,
+// outside is the number of samples taken before the first instruction ran. Without any samples no file is written.
+bool reportSamples(FILE * out, const InstructionArray * instructions, const uint64_t * samples, uint64_t outside);
+// Joins the counters an instrumented executable wrote back to the lines of its source
+bool reportCounts(const char * countsPath);
+
+#endif // _REPORT_H
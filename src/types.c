@@ -10,6 +10,29 @@ Value i32Value(int32_t n)
 	return v;
 }
 
+static const char * tokenTypeNames[] = {
+	[TOK_PUSH] = "push",
+	[TOK_PLUS] = "+",
+	[TOK_MINUS] = "-",
+	[TOK_MULTIPLY] = "*",
+	[TOK_DIVIDE] = "/",
+	[TOK_DUMP] = ".",
+	[TOK_EQUAL] = "=",
+	[TOK_IF] = "if",
+	[TOK_ELSE] = "else",
+	[TOK_END] = "end",
+	[TOK_DUP] = "dup",
+	[TOK_GT] = ">",
+	[TOK_WHILE] = "while",
+	[TOK_DO] = "do",
+	[TOK_LT] = "<",
+};
+
+const char * tokenTypeName(TokenType type)
+{
+	return tokenTypeNames[type];
+}
+
 Token makeToken(const char * filePath, size_t lineNum, size_t colNum, TokenType type)
 {
 	Token t = {0};
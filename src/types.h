@@ -5,6 +5,9 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+// Part of the compile cache key, along with the minos executable itself
+#define MINOS_VERSION "0.1.0"
+
 typedef enum {
 	TOK_PUSH = 0,
 	TOK_PLUS,
@@ -73,5 +76,7 @@ typedef struct {
 Value i32Value(int32_t n);
 
 Token makeToken(const char * filePath, size_t lineNum, size_t colNum, TokenType type);
+// How the instruction is spelled in a program, numbers and booleans are all "push"
+const char * tokenTypeName(TokenType type);
 
 #endif // _TYPES_H
@@ -0,0 +1,262 @@
+#include "verifier.h"
+
+#include "error.h"
+#include "nob.h"
+
+typedef struct {
+	size_t pops;
+	size_t pushes;
+} StackEffect;
+
+static const StackEffect effectLookup[] = {
+	[TOK_PUSH] = { 0, 1 },
+	[TOK_PLUS] = { 2, 1 },
+	[TOK_MINUS] = { 2, 1 },
+	[TOK_MULTIPLY] = { 2, 1 },
+	[TOK_DIVIDE] = { 2, 1 },
+	[TOK_DUMP] = { 1, 0 },
+	[TOK_EQUAL] = { 2, 1 },
+	[TOK_IF] = { 1, 0 },
+	[TOK_ELSE] = { 0, 0 },
+	[TOK_END] = { 0, 0 },
+	[TOK_DUP] = { 1, 2 },
+	[TOK_GT] = { 2, 1 },
+	[TOK_WHILE] = { 0, 0 },
+	[TOK_DO] = { 1, 0 },
+	[TOK_LT] = { 2, 1 },
+};
+
+static void verifierError(const InstructionArray * instructions, size_t ip, Error error, bool report)
+{
+	if (!report) return;
+	Token token = instructions->items[ip].token;
+	reportError(token.filePath, token.lineNum, token.colNum, error);
+}
+
+// Follows the same control flow as the interpreter, the second successor is SIZE_MAX when there is only one
+static size_t successors(const Instruction * instruction, size_t ip, size_t * branch)
+{
+	*branch = SIZE_MAX;
+	switch (instruction->token.type) {
+	case TOK_IF:
+	case TOK_DO:
+		*branch = instruction->value.i32;
+		return ip + 1;
+	case TOK_ELSE:
+	case TOK_END:
+		return instruction->value.i32;
+	default:
+		return ip + 1;
+	}
+}
+
+// Worklist over the instructions reachable from first, depths[first] has to be set already.
+// Control flow that reaches stop leaves the region, minDepth and maxDepth cover the depths in between.
+static bool propagateDepths(const InstructionArray * instructions, size_t * depths, size_t first, size_t stop, size_t * minDepth, size_t * maxDepth, bool report)
+{
+	bool success = true;
+	IndexStack worklist = {0};
+	*minDepth = depths[first];
+	*maxDepth = depths[first];
+	nob_da_append(&worklist, first);
+
+	while (worklist.count > 0 && success) {
+		size_t ip = worklist.items[--worklist.count];
+		const Instruction * instruction = &instructions->items[ip];
+		StackEffect effect = effectLookup[instruction->token.type];
+		size_t depth = depths[ip];
+
+		if (depth < effect.pops) {
+			verifierError(instructions, ip, ERROR_SEGFAULT_POP_FROM_EMPTY_STACK, report);
+			success = false;
+			continue;
+		}
+		depth = depth - effect.pops;
+		if (depth < *minDepth) *minDepth = depth;
+		depth = depth + effect.pushes;
+		if (depth > *maxDepth) *maxDepth = depth;
+
+		size_t targets[2];
+		targets[0] = successors(instruction, ip, &targets[1]);
+		for (size_t i = 0; i < NOB_ARRAY_LEN(targets) && success; i++) {
+			size_t target = targets[i];
+			if (target == stop) {
+				// Leaving is fine with any depth, the first one is kept for the code that follows
+				if (depths[stop] == UNKNOWN_DEPTH) depths[stop] = depth;
+				continue;
+			}
+			if (target >= instructions->count) continue;
+			if (target < first || target > stop) {
+				success = false;
+			} else if (depths[target] == UNKNOWN_DEPTH) {
+				depths[target] = depth;
+				nob_da_append(&worklist, target);
+			} else if (depths[target] != depth) {
+				// Control flow only merges at the start of a loop or at the 'end' of an if
+				if (instructions->items[target].token.type == TOK_WHILE) {
+					verifierError(instructions, target, ERROR_LOOP_CHANGES_STACK, report);
+				} else {
+					verifierError(instructions, target, ERROR_UNBALANCED_BRANCHES, report);
+				}
+				success = false;
+			}
+		}
+	}
+
+	nob_da_free(worklist);
+	return success;
+}
+
+static size_t * unknownDepths(size_t count)
+{
+	size_t * depths = malloc((count + 1) * sizeof(*depths));
+	assert(depths != NULL && "Buy more RAM lol");
+	for (size_t i = 0; i <= count; i++) {
+		depths[i] = UNKNOWN_DEPTH;
+	}
+	return depths;
+}
+
+bool verifyStackEffects(const InstructionArray * instructions, StackEffects * effects, bool report)
+{
+	effects->count = instructions->count;
+	effects->maxDepth = 0;
+	effects->depths = unknownDepths(instructions->count);
+	if (instructions->count == 0) return true;
+
+	size_t minDepth;
+	effects->depths[0] = 0;
+	return propagateDepths(instructions, effects->depths, 0, instructions->count, &minDepth, &effects->maxDepth, report);
+}
+
+// Starts the region off with so many items that it can't underflow, sees how far it moves away from there
+// in both directions and then counts from the deepest item it touches instead
+static bool propagateFromAnyDepth(const InstructionArray * instructions, StackEffects * effects, size_t first, size_t stop, bool report)
+{
+	const size_t bias = SIZE_MAX / 2;
+	effects->depths[first] = bias;
+	size_t minDepth;
+	bool success = propagateDepths(instructions, effects->depths, first, stop, &minDepth, &effects->maxDepth, report);
+	for (size_t i = first; i <= stop && i <= instructions->count; i++) {
+		if (effects->depths[i] != UNKNOWN_DEPTH) effects->depths[i] -= minDepth;
+	}
+	effects->maxDepth -= minDepth;
+	return success;
+}
+
+bool verifyLoop(const InstructionArray * instructions, size_t endIp, StackEffects * effects)
+{
+	size_t whileIp = instructions->items[endIp].value.i32;
+	assert(instructions->items[whileIp].token.type == TOK_WHILE);
+	effects->count = instructions->count;
+	effects->depths = unknownDepths(instructions->count);
+	return propagateFromAnyDepth(instructions, effects, whileIp, endIp + 1, false);
+}
+
+bool verifyRoutine(const InstructionArray * instructions, StackEffects * effects, bool report)
+{
+	effects->count = instructions->count;
+	effects->maxDepth = 0;
+	effects->depths = unknownDepths(instructions->count);
+	if (instructions->count == 0) {
+		effects->depths[0] = 0;
+		return true;
+	}
+	return propagateFromAnyDepth(instructions, effects, 0, instructions->count, report);
+}
+
+void freeStackEffects(StackEffects * effects)
+{
+	free(effects->depths);
+	*effects = (StackEffects) {0};
+}
+
+static bool mergeTypes(ValueType ** entries, size_t target, const ValueType * types, size_t depth, IndexStack * worklist)
+{
+	if (entries[target] == NULL) {
+		entries[target] = malloc((depth + 1) * sizeof(*entries[target]));
+		assert(entries[target] != NULL && "Buy more RAM lol");
+		memcpy(entries[target], types, depth * sizeof(*types));
+		nob_da_append(worklist, target);
+		return true;
+	}
+	return memcmp(entries[target], types, depth * sizeof(*types)) == 0;
+}
+
+// Abstract interpretation over value types instead of values, it needs the depths from a
+// successful verifyStackEffects so every merge point agrees on how many slots to compare
+bool inferI32Types(const InstructionArray * instructions, const StackEffects * effects)
+{
+	if (instructions->count == 0) return true;
+
+	bool success = true;
+	ValueType ** entries = calloc(instructions->count, sizeof(*entries));
+	ValueType * types = malloc((effects->maxDepth + 1) * sizeof(*types));
+	assert(entries != NULL && types != NULL && "Buy more RAM lol");
+	IndexStack worklist = {0};
+
+	entries[0] = malloc(sizeof(*entries[0]));
+	assert(entries[0] != NULL && "Buy more RAM lol");
+	nob_da_append(&worklist, 0);
+
+	while (worklist.count > 0 && success) {
+		size_t ip = worklist.items[--worklist.count];
+		const Instruction * instruction = &instructions->items[ip];
+		size_t depth = effects->depths[ip];
+		memcpy(types, entries[ip], depth * sizeof(*types));
+
+		switch (instruction->token.type) {
+		case TOK_PUSH:
+			types[depth++] = instruction->value.type;
+			break;
+		case TOK_PLUS:
+		case TOK_MINUS:
+		case TOK_MULTIPLY:
+		case TOK_DIVIDE:
+		case TOK_EQUAL:
+		case TOK_GT:
+		case TOK_LT:
+			success = types[depth - 1] == I32 && types[depth - 2] == I32;
+			depth -= 1;
+			types[depth - 1] = I32;
+			break;
+		case TOK_DUMP:
+			depth -= 1;
+			break;
+		case TOK_IF:
+		case TOK_DO:
+			success = types[depth - 1] == I32;
+			depth -= 1;
+			break;
+		case TOK_DUP:
+			types[depth] = types[depth - 1];
+			depth += 1;
+			break;
+		case TOK_ELSE:
+		case TOK_END:
+		case TOK_WHILE:
+			break;
+		default:
+			assert(false && "Unreachable");
+			break;
+		}
+		for (size_t i = 0; i < depth && success; i++) {
+			success = types[i] == I32;
+		}
+
+		size_t targets[2];
+		targets[0] = successors(instruction, ip, &targets[1]);
+		for (size_t i = 0; i < NOB_ARRAY_LEN(targets) && success; i++) {
+			if (targets[i] >= instructions->count) continue;
+			success = mergeTypes(entries, targets[i], types, depth, &worklist);
+		}
+	}
+
+	for (size_t i = 0; i < instructions->count; i++) {
+		free(entries[i]);
+	}
+	free(entries);
+	free(types);
+	nob_da_free(worklist);
+	return success;
+}
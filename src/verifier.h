@@ -0,0 +1,25 @@
+#ifndef _VERIFIER_H
+#define _VERIFIER_H
+
+#include "types.h"
+
+#define UNKNOWN_DEPTH SIZE_MAX
+
+typedef struct {
+	size_t * depths; // Stack depth on entry to each instruction and after the last one, UNKNOWN_DEPTH when it can't be reached
+	size_t count;
+	size_t maxDepth;
+} StackEffects;
+
+bool verifyStackEffects(const InstructionArray * instructions, StackEffects * effects, bool report);
+// Checks the 'while' loop closed by the 'end' at endIp on its own, as if entered with an unknown number of items on the stack.
+// The depths of its instructions and of the one it exits to count from the deepest of those items it touches,
+// so the depth of the 'while' is how many items it needs.
+bool verifyLoop(const InstructionArray * instructions, size_t endIp, StackEffects * effects);
+// Checks the whole program the same way, as a routine that is called with items already on the stack.
+// depths[0] is how many of them it takes and depths[count] how many it leaves in their place.
+bool verifyRoutine(const InstructionArray * instructions, StackEffects * effects, bool report);
+void freeStackEffects(StackEffects * effects);
+bool inferI32Types(const InstructionArray * instructions, const StackEffects * effects);
+
+#endif // _VERIFIER_H
@@ -0,0 +1,657 @@
+#include "x86.h"
+
+#include "nob.h"
+
+static const char * registerNames64[] = { "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15" };
+static const char * registerNames32[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d" };
+static const char * registerNames8[] = { "al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b" };
+static const char * conditionNames[] = { "o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g" };
+
+static const char * mnemonicNames[] = {
+	[MN_ADD] = "add",
+	[MN_OR] = "or",
+	[MN_AND] = "and",
+	[MN_SUB] = "sub",
+	[MN_XOR] = "xor",
+	[MN_CMP] = "cmp",
+	[MN_MOV] = "mov",
+	[MN_TEST] = "test",
+	[MN_LEA] = "lea",
+	[MN_IMUL] = "imul",
+	[MN_MUL] = "mul",
+	[MN_DIV] = "div",
+	[MN_IDIV] = "idiv",
+	[MN_NEG] = "neg",
+	[MN_NOT] = "not",
+	[MN_INC] = "inc",
+	[MN_DEC] = "dec",
+	[MN_SHL] = "shl",
+	[MN_SHR] = "shr",
+	[MN_SAR] = "sar",
+	[MN_MOVZX] = "movzx",
+	[MN_MOVSXD] = "movsxd",
+	[MN_PUSH] = "push",
+	[MN_POP] = "pop",
+	[MN_CALL] = "call",
+	[MN_CQO] = "cqo",
+	[MN_CDQ] = "cdq",
+	[MN_SYSCALL] = "syscall",
+	[MN_RET] = "ret",
+};
+
+// Opcode extension of the 0x80/0x81/0x83 group, also the base opcode divided by 8
+static const uint8_t aluDigits[] = {
+	[MN_ADD] = 0,
+	[MN_OR] = 1,
+	[MN_AND] = 4,
+	[MN_SUB] = 5,
+	[MN_XOR] = 6,
+	[MN_CMP] = 7,
+};
+
+// Opcode extension of the 0xF6/0xF7 and 0xC0/0xC1 groups
+static const uint8_t unaryDigits[] = {
+	[MN_NOT] = 2,
+	[MN_NEG] = 3,
+	[MN_MUL] = 4,
+	[MN_IMUL] = 5,
+	[MN_DIV] = 6,
+	[MN_IDIV] = 7,
+	[MN_SHL] = 4,
+	[MN_SHR] = 5,
+	[MN_SAR] = 7,
+};
+
+Operand r64(Register reg)
+{
+	Operand x = {0};
+	x.kind = OPERAND_REGISTER;
+	x.size = 8;
+	x.base = reg;
+	return x;
+}
+
+Operand r32(Register reg)
+{
+	Operand x = r64(reg);
+	x.size = 4;
+	return x;
+}
+
+Operand r8(Register reg)
+{
+	Operand x = r64(reg);
+	x.size = 1;
+	return x;
+}
+
+Operand imm(int64_t value)
+{
+	Operand x = {0};
+	x.kind = OPERAND_IMMEDIATE;
+	x.value = value;
+	return x;
+}
+
+Operand mem(uint8_t size, Register base, int32_t disp)
+{
+	Operand x = {0};
+	x.kind = OPERAND_MEMORY;
+	x.size = size;
+	x.base = base;
+	x.value = disp;
+	return x;
+}
+
+Operand memIndex(uint8_t size, Register base, Register index, uint8_t scale, int32_t disp)
+{
+	assert(index != RSP && (scale == 1 || scale == 2 || scale == 4 || scale == 8));
+	Operand x = mem(size, base, disp);
+	x.index = index;
+	x.hasIndex = true;
+	x.scale = scale;
+	return x;
+}
+
+Operand memLabel(uint8_t size, size_t label)
+{
+	Operand x = {0};
+	x.kind = OPERAND_LABEL;
+	x.size = size;
+	x.label = label;
+	return x;
+}
+
+Operand memLabelDisp(uint8_t size, size_t label, int32_t disp)
+{
+	Operand x = memLabel(size, label);
+	x.value = disp;
+	return x;
+}
+
+void asmInit(Assembler * a, FILE * out)
+{
+	*a = (Assembler) {0};
+	a->out = out;
+}
+
+void asmFree(Assembler * a)
+{
+	for (size_t i = 0; i < a->labels.count; i++) {
+		free((char *)a->labels.items[i].name);
+	}
+	nob_da_free(a->code);
+	nob_da_free(a->labels);
+	nob_da_free(a->fixups);
+	nob_da_free(a->lines);
+	*a = (Assembler) {0};
+}
+
+size_t asmNewLabel(Assembler * a, const char * name)
+{
+	Label label = {0};
+	label.name = strdup(name);
+	assert(label.name != NULL && "Buy more RAM lol");
+	nob_da_append(&a->labels, label);
+	return a->labels.count - 1;
+}
+
+void asmBind(Assembler * a, size_t label)
+{
+	assert(!a->labels.items[label].bound);
+	a->labels.items[label].bound = true;
+	a->labels.items[label].offset = a->code.count;
+	a->lastBound = label;
+	if (a->out) fprintf(a->out, "%s:\n", a->labels.items[label].name);
+}
+
+void asmGlobal(Assembler * a, size_t label)
+{
+	if (a->out) fprintf(a->out, "global %s\n", a->labels.items[label].name);
+}
+
+void asmText(Assembler * a, const char * text)
+{
+	if (a->out) fputs(text, a->out);
+}
+
+void asmData(Assembler * a, const uint8_t * bytes, size_t count)
+{
+	if (a->labels.count > 0 && a->labels.items[a->lastBound].offset == a->code.count) a->labels.items[a->lastBound].data = true;
+	if (a->out == NULL) {
+		nob_da_append_many(&a->code, bytes, count);
+		return;
+	}
+	for (size_t i = 0; i < count; i += 16) {
+		fprintf(a->out, "    db      ");
+		for (size_t j = i; j < count && j < i + 16; j++) {
+			fprintf(a->out, j == i ? "%u" : ", %u", bytes[j]);
+		}
+		fprintf(a->out, "\n");
+	}
+}
+
+void asmReserve(Assembler * a, size_t label, size_t size)
+{
+	assert(!a->labels.items[label].bound);
+	// Every block gets 16 byte alignment, nothing reserved here needs more
+	a->reservedSize = (a->reservedSize + 15) & ~(size_t)15;
+	a->labels.items[label].bound = true;
+	a->labels.items[label].reserved = true;
+	a->labels.items[label].offset = a->reservedSize;
+	a->reservedSize += size;
+	if (a->out) fprintf(a->out, "%s: resb %zu\n", a->labels.items[label].name, size);
+}
+
+void asmLine(Assembler * a, const char * filePath, size_t line, size_t column)
+{
+	if (!a->lineInfo) return;
+	SourceLine * last = a->lines.count > 0 ? &a->lines.items[a->lines.count - 1] : NULL;
+	if (a->out) {
+		// nasm only knows about lines, and +0 keeps every line after the directive on this one
+		if (last == NULL || last->line != line || strcmp(last->filePath, filePath) != 0) {
+			fprintf(a->out, "%%line %zu+0 %s\n", line, filePath);
+		}
+	} else if (last != NULL && last->offset == a->code.count) {
+		// The previous place didn't generate any code
+		a->lines.count -= 1;
+	}
+	SourceLine source = { a->code.count, filePath, line, column };
+	nob_da_append(&a->lines, source);
+}
+
+// nasm syntax
+
+static const char * sizeName(uint8_t size)
+{
+	switch (size) {
+	case 1: return "BYTE";
+	case 4: return "DWORD";
+	case 8: return "QWORD";
+	default:
+		assert(false && "Unreachable");
+		return NULL;
+	}
+}
+
+static const char * formatOperand(Assembler * a, Operand x, bool sized)
+{
+	switch (x.kind) {
+	case OPERAND_REGISTER:
+		switch (x.size) {
+		case 1: return registerNames8[x.base];
+		case 4: return registerNames32[x.base];
+		case 8: return registerNames64[x.base];
+		default:
+			assert(false && "Unreachable");
+			return NULL;
+		}
+	case OPERAND_IMMEDIATE:
+		return nob_temp_sprintf("%lld", (long long)x.value);
+	case OPERAND_MEMORY: {
+		const char * address = registerNames64[x.base];
+		if (x.hasIndex) address = nob_temp_sprintf("%s+%s*%u", address, registerNames64[x.index], x.scale);
+		if (x.value) address = nob_temp_sprintf("%s%+lld", address, (long long)x.value);
+		return nob_temp_sprintf("%s%s[%s]", sized ? sizeName(x.size) : "", sized ? " " : "", address);
+	}
+	case OPERAND_LABEL:
+		if (x.value != 0) {
+			return nob_temp_sprintf("%s%s[rel %s%+d]", sized ? sizeName(x.size) : "", sized ? " " : "", a->labels.items[x.label].name, (int)x.value);
+		}
+		return nob_temp_sprintf("%s%s[rel %s]", sized ? sizeName(x.size) : "", sized ? " " : "", a->labels.items[x.label].name);
+	default:
+		assert(false && "Unreachable");
+		return NULL;
+	}
+}
+
+static void printInstruction(Assembler * a, const char * mnemonic, const char * operands)
+{
+	if (operands) {
+		fprintf(a->out, "    %-8s%s\n", mnemonic, operands);
+	} else {
+		fprintf(a->out, "    %s\n", mnemonic);
+	}
+	nob_temp_reset();
+}
+
+// Machine code
+
+static void emitByte(Assembler * a, uint8_t byte)
+{
+	nob_da_append(&a->code, byte);
+}
+
+static void emitLittleEndian(Assembler * a, int64_t value, size_t size)
+{
+	for (size_t i = 0; i < size; i++) {
+		emitByte(a, (uint8_t)((uint64_t)value >> (8 * i)));
+	}
+}
+
+static bool fitsI8(int64_t value)
+{
+	return value >= INT8_MIN && value <= INT8_MAX;
+}
+
+static bool fitsI32(int64_t value)
+{
+	return value >= INT32_MIN && value <= INT32_MAX;
+}
+
+// spl, bpl, sil and dil only exist with a REX prefix, without one the same numbers mean ah, ch, dh and bh
+static bool needsRex(Operand x)
+{
+	return x.kind == OPERAND_REGISTER && x.size == 1 && x.base >= RSP && x.base <= RDI;
+}
+
+// Emits [REX] opcode ModRM [SIB] [disp], reg is either a register or an opcode extension.
+// immediateSize is how many bytes still follow, RIP relative displacements are measured from after them.
+static void encode(Assembler * a, bool wide, bool forceRex, const uint8_t * opcode, size_t opcodeCount, int reg, Operand rm, size_t immediateSize)
+{
+	uint8_t rex = 0x40;
+	if (wide) rex |= 0x08;
+	if (reg & 8) rex |= 0x04;
+	if (rm.kind == OPERAND_MEMORY && rm.hasIndex && (rm.index & 8)) rex |= 0x02;
+	if ((rm.kind == OPERAND_MEMORY || rm.kind == OPERAND_REGISTER) && (rm.base & 8)) rex |= 0x01;
+	if (rex != 0x40 || forceRex || needsRex(rm)) emitByte(a, rex);
+
+	for (size_t i = 0; i < opcodeCount; i++) {
+		emitByte(a, opcode[i]);
+	}
+
+	reg &= 7;
+	switch (rm.kind) {
+	case OPERAND_REGISTER:
+		emitByte(a, 0xC0 | reg << 3 | (rm.base & 7));
+		break;
+	case OPERAND_LABEL: {
+		emitByte(a, 0x05 | reg << 3);
+		Fixup fixup = {0};
+		fixup.offset = a->code.count;
+		fixup.end = a->code.count + 4 + immediateSize;
+		fixup.label = rm.label;
+		fixup.addend = rm.value;
+		nob_da_append(&a->fixups, fixup);
+		emitLittleEndian(a, 0, 4);
+		break;
+	}
+	case OPERAND_MEMORY: {
+		int base = rm.base & 7;
+		int32_t disp = (int32_t)rm.value;
+		// rbp and r13 as a base always need a displacement, mod 00 means RIP relative for them
+		uint8_t mod = (disp == 0 && base != RBP) ? 0 : (fitsI8(disp) ? 1 : 2);
+		bool sib = rm.hasIndex || base == RSP;
+		emitByte(a, mod << 6 | reg << 3 | (sib ? RSP : base));
+		if (sib) {
+			uint8_t scale = rm.hasIndex ? (rm.scale == 8 ? 3 : rm.scale == 4 ? 2 : rm.scale == 2 ? 1 : 0) : 0;
+			uint8_t index = rm.hasIndex ? (rm.index & 7) : RSP;
+			emitByte(a, scale << 6 | index << 3 | base);
+		}
+		if (mod == 1) emitLittleEndian(a, disp, 1);
+		if (mod == 2) emitLittleEndian(a, disp, 4);
+		break;
+	}
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+}
+
+static void encode1(Assembler * a, bool wide, bool forceRex, uint8_t opcode, int reg, Operand rm, size_t immediateSize)
+{
+	encode(a, wide, forceRex, &opcode, 1, reg, rm, immediateSize);
+}
+
+static void encode2(Assembler * a, bool wide, bool forceRex, uint8_t opcode0, uint8_t opcode1, int reg, Operand rm, size_t immediateSize)
+{
+	uint8_t opcode[] = { opcode0, opcode1 };
+	encode(a, wide, forceRex, opcode, 2, reg, rm, immediateSize);
+}
+
+// Short forms like push/pop/mov with the register in the low bits of the opcode
+static void encodeShort(Assembler * a, bool wide, uint8_t opcode, Register reg)
+{
+	uint8_t rex = 0x40 | (wide ? 0x08 : 0) | (reg & 8 ? 0x01 : 0);
+	if (rex != 0x40) emitByte(a, rex);
+	emitByte(a, opcode + (reg & 7));
+}
+
+void asmOp0(Assembler * a, Mnemonic mnemonic)
+{
+	if (a->out) {
+		printInstruction(a, mnemonicNames[mnemonic], NULL);
+		return;
+	}
+	switch (mnemonic) {
+	case MN_CQO:
+		emitByte(a, 0x48);
+		emitByte(a, 0x99);
+		break;
+	case MN_CDQ:
+		emitByte(a, 0x99);
+		break;
+	case MN_SYSCALL:
+		emitByte(a, 0x0F);
+		emitByte(a, 0x05);
+		break;
+	case MN_RET:
+		emitByte(a, 0xC3);
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+}
+
+void asmOp1(Assembler * a, Mnemonic mnemonic, Operand x)
+{
+	if (a->out) {
+		printInstruction(a, mnemonicNames[mnemonic], formatOperand(a, x, x.kind != OPERAND_REGISTER));
+		return;
+	}
+	bool wide = x.size == 8;
+	switch (mnemonic) {
+	case MN_PUSH:
+		if (x.kind == OPERAND_REGISTER) {
+			encodeShort(a, false, 0x50, x.base);
+		} else if (x.kind == OPERAND_IMMEDIATE) {
+			assert(fitsI32(x.value));
+			if (fitsI8(x.value)) {
+				emitByte(a, 0x6A);
+				emitLittleEndian(a, x.value, 1);
+			} else {
+				emitByte(a, 0x68);
+				emitLittleEndian(a, x.value, 4);
+			}
+		} else {
+			encode1(a, false, false, 0xFF, 6, x, 0);
+		}
+		break;
+	case MN_POP:
+		if (x.kind == OPERAND_REGISTER) {
+			encodeShort(a, false, 0x58, x.base);
+		} else {
+			encode1(a, false, false, 0x8F, 0, x, 0);
+		}
+		break;
+	case MN_CALL:
+		assert(x.kind != OPERAND_IMMEDIATE);
+		encode1(a, false, false, 0xFF, 2, x, 0);
+		break;
+	case MN_MUL:
+	case MN_IMUL:
+	case MN_DIV:
+	case MN_IDIV:
+	case MN_NEG:
+	case MN_NOT:
+		encode1(a, wide, false, x.size == 1 ? 0xF6 : 0xF7, unaryDigits[mnemonic], x, 0);
+		break;
+	case MN_INC:
+	case MN_DEC:
+		encode1(a, wide, false, x.size == 1 ? 0xFE : 0xFF, mnemonic == MN_INC ? 0 : 1, x, 0);
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+}
+
+void asmOp2(Assembler * a, Mnemonic mnemonic, Operand dst, Operand src)
+{
+	if (a->out) {
+		// Memory operands only need an explicit size when the other operand doesn't give one away
+		bool sized = src.kind == OPERAND_IMMEDIATE || mnemonic == MN_MOVZX || mnemonic == MN_MOVSXD;
+		const char * first = formatOperand(a, dst, sized);
+		const char * second = formatOperand(a, src, sized && mnemonic != MN_LEA);
+		printInstruction(a, mnemonicNames[mnemonic], nob_temp_sprintf("%s, %s", first, second));
+		return;
+	}
+	bool wide = dst.size == 8;
+	bool byte = dst.size == 1;
+	switch (mnemonic) {
+	case MN_ADD:
+	case MN_OR:
+	case MN_AND:
+	case MN_SUB:
+	case MN_XOR:
+	case MN_CMP: {
+		uint8_t base = aluDigits[mnemonic] * 8;
+		if (src.kind == OPERAND_IMMEDIATE) {
+			assert(fitsI32(src.value));
+			if (byte) {
+				encode1(a, false, false, 0x80, aluDigits[mnemonic], dst, 1);
+				emitLittleEndian(a, src.value, 1);
+			} else if (fitsI8(src.value)) {
+				encode1(a, wide, false, 0x83, aluDigits[mnemonic], dst, 1);
+				emitLittleEndian(a, src.value, 1);
+			} else {
+				encode1(a, wide, false, 0x81, aluDigits[mnemonic], dst, 4);
+				emitLittleEndian(a, src.value, 4);
+			}
+		} else if (src.kind == OPERAND_REGISTER) {
+			encode1(a, wide, needsRex(src), base + (byte ? 0 : 1), src.base, dst, 0);
+		} else {
+			assert(dst.kind == OPERAND_REGISTER);
+			encode1(a, wide, needsRex(dst), base + (byte ? 2 : 3), dst.base, src, 0);
+		}
+		break;
+	}
+	case MN_MOV:
+		if (src.kind == OPERAND_IMMEDIATE && dst.kind == OPERAND_REGISTER) {
+			if (byte) {
+				if (needsRex(dst)) emitByte(a, 0x40);
+				encodeShort(a, false, 0xB0, dst.base);
+				emitLittleEndian(a, src.value, 1);
+			} else if (wide && !fitsI32(src.value)) {
+				encodeShort(a, true, 0xB8, dst.base);
+				emitLittleEndian(a, src.value, 8);
+			} else if (wide) {
+				encode1(a, true, false, 0xC7, 0, dst, 4);
+				emitLittleEndian(a, src.value, 4);
+			} else {
+				encodeShort(a, false, 0xB8, dst.base);
+				emitLittleEndian(a, src.value, 4);
+			}
+		} else if (src.kind == OPERAND_IMMEDIATE) {
+			assert(fitsI32(src.value));
+			encode1(a, wide, false, byte ? 0xC6 : 0xC7, 0, dst, byte ? 1 : 4);
+			emitLittleEndian(a, src.value, byte ? 1 : 4);
+		} else if (src.kind == OPERAND_REGISTER) {
+			encode1(a, wide, needsRex(src), byte ? 0x88 : 0x89, src.base, dst, 0);
+		} else {
+			assert(dst.kind == OPERAND_REGISTER);
+			encode1(a, wide, needsRex(dst), byte ? 0x8A : 0x8B, dst.base, src, 0);
+		}
+		break;
+	case MN_TEST:
+		if (src.kind == OPERAND_IMMEDIATE) {
+			encode1(a, wide, false, byte ? 0xF6 : 0xF7, 0, dst, byte ? 1 : 4);
+			emitLittleEndian(a, src.value, byte ? 1 : 4);
+		} else {
+			assert(src.kind == OPERAND_REGISTER);
+			encode1(a, wide, needsRex(src), byte ? 0x84 : 0x85, src.base, dst, 0);
+		}
+		break;
+	case MN_LEA:
+		assert(dst.kind == OPERAND_REGISTER && (src.kind == OPERAND_MEMORY || src.kind == OPERAND_LABEL));
+		encode1(a, wide, false, 0x8D, dst.base, src, 0);
+		break;
+	case MN_IMUL:
+		assert(dst.kind == OPERAND_REGISTER);
+		encode2(a, wide, false, 0x0F, 0xAF, dst.base, src, 0);
+		break;
+	case MN_MOVZX:
+		assert(dst.kind == OPERAND_REGISTER && src.size == 1);
+		encode2(a, wide, false, 0x0F, 0xB6, dst.base, src, 0);
+		break;
+	case MN_MOVSXD:
+		assert(dst.kind == OPERAND_REGISTER && dst.size == 8 && src.size == 4);
+		encode1(a, true, false, 0x63, dst.base, src, 0);
+		break;
+	case MN_SHL:
+	case MN_SHR:
+	case MN_SAR:
+		assert(src.kind == OPERAND_IMMEDIATE);
+		encode1(a, wide, false, byte ? 0xC0 : 0xC1, unaryDigits[mnemonic], dst, 1);
+		emitLittleEndian(a, src.value, 1);
+		break;
+	default:
+		assert(false && "Unreachable");
+		break;
+	}
+}
+
+void asmOp3(Assembler * a, Mnemonic mnemonic, Operand dst, Operand src, Operand extra)
+{
+	assert(mnemonic == MN_IMUL && dst.kind == OPERAND_REGISTER && extra.kind == OPERAND_IMMEDIATE);
+	if (a->out) {
+		const char * first = formatOperand(a, dst, false);
+		const char * second = formatOperand(a, src, src.kind != OPERAND_REGISTER);
+		printInstruction(a, mnemonicNames[mnemonic], nob_temp_sprintf("%s, %s, %lld", first, second, (long long)extra.value));
+		return;
+	}
+	if (fitsI8(extra.value)) {
+		encode1(a, dst.size == 8, false, 0x6B, dst.base, src, 1);
+		emitLittleEndian(a, extra.value, 1);
+	} else {
+		encode1(a, dst.size == 8, false, 0x69, dst.base, src, 4);
+		emitLittleEndian(a, extra.value, 4);
+	}
+}
+
+static void emitRelative(Assembler * a, size_t label)
+{
+	Fixup fixup = {0};
+	fixup.offset = a->code.count;
+	fixup.end = a->code.count + 4;
+	fixup.label = label;
+	nob_da_append(&a->fixups, fixup);
+	emitLittleEndian(a, 0, 4);
+}
+
+void asmJmp(Assembler * a, size_t label)
+{
+	if (a->out) {
+		printInstruction(a, "jmp", a->labels.items[label].name);
+		return;
+	}
+	emitByte(a, 0xE9);
+	emitRelative(a, label);
+}
+
+void asmCall(Assembler * a, size_t label)
+{
+	if (a->out) {
+		printInstruction(a, "call", a->labels.items[label].name);
+		return;
+	}
+	emitByte(a, 0xE8);
+	emitRelative(a, label);
+}
+
+void asmJcc(Assembler * a, Condition cc, size_t label)
+{
+	if (a->out) {
+		printInstruction(a, nob_temp_sprintf("j%s", conditionNames[cc]), a->labels.items[label].name);
+		return;
+	}
+	emitByte(a, 0x0F);
+	emitByte(a, 0x80 + cc);
+	emitRelative(a, label);
+}
+
+void asmSetcc(Assembler * a, Condition cc, Operand dst)
+{
+	assert(dst.size == 1);
+	if (a->out) {
+		printInstruction(a, nob_temp_sprintf("set%s", conditionNames[cc]), formatOperand(a, dst, dst.kind != OPERAND_REGISTER));
+		return;
+	}
+	encode2(a, false, false, 0x0F, 0x90 + cc, 0, dst, 0);
+}
+
+void asmCmov(Assembler * a, Condition cc, Operand dst, Operand src)
+{
+	assert(dst.kind == OPERAND_REGISTER && dst.size != 1);
+	if (a->out) {
+		printInstruction(a, nob_temp_sprintf("cmov%s", conditionNames[cc]), nob_temp_sprintf("%s, %s", formatOperand(a, dst, false), formatOperand(a, src, false)));
+		return;
+	}
+	encode2(a, dst.size == 8, false, 0x0F, 0x40 + cc, dst.base, src, 0);
+}
+
+void asmResolve(Assembler * a)
+{
+	for (size_t i = 0; i < a->fixups.count; i++) {
+		Fixup fixup = a->fixups.items[i];
+		Label label = a->labels.items[fixup.label];
+		assert(label.bound && "Jump to a label that was never bound");
+		size_t offset = label.reserved ? a->reservedOffset + label.offset : label.offset;
+		int64_t relative = (int64_t)offset + fixup.addend - (int64_t)fixup.end;
+		assert(fitsI32(relative));
+		for (size_t j = 0; j < 4; j++) {
+			a->code.items[fixup.offset + j] = (uint8_t)((uint64_t)relative >> (8 * j));
+		}
+	}
+}
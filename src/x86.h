@@ -0,0 +1,185 @@
+#ifndef _X86_H
+#define _X86_H
+
+#include "types.h"
+#include <stdio.h>
+
+typedef enum {
+	RAX = 0,
+	RCX,
+	RDX,
+	RBX,
+	RSP,
+	RBP,
+	RSI,
+	RDI,
+	R8,
+	R9,
+	R10,
+	R11,
+	R12,
+	R13,
+	R14,
+	R15,
+} Register;
+
+typedef enum {
+	CC_O = 0,
+	CC_NO,
+	CC_B,
+	CC_AE,
+	CC_E,
+	CC_NE,
+	CC_BE,
+	CC_A,
+	CC_S,
+	CC_NS,
+	CC_P,
+	CC_NP,
+	CC_L,
+	CC_GE,
+	CC_LE,
+	CC_G,
+} Condition;
+
+#define CC_Z CC_E
+#define CC_NZ CC_NE
+
+typedef enum {
+	MN_ADD = 0,
+	MN_OR,
+	MN_AND,
+	MN_SUB,
+	MN_XOR,
+	MN_CMP,
+	MN_MOV,
+	MN_TEST,
+	MN_LEA,
+	MN_IMUL,
+	MN_MUL,
+	MN_DIV,
+	MN_IDIV,
+	MN_NEG,
+	MN_NOT,
+	MN_INC,
+	MN_DEC,
+	MN_SHL,
+	MN_SHR,
+	MN_SAR,
+	MN_MOVZX,
+	MN_MOVSXD,
+	MN_PUSH,
+	MN_POP,
+	MN_CALL, // Indirect, asmCall calls a label
+	MN_CQO,
+	MN_CDQ,
+	MN_SYSCALL,
+	MN_RET,
+} Mnemonic;
+
+typedef enum {
+	OPERAND_REGISTER,
+	OPERAND_IMMEDIATE,
+	OPERAND_MEMORY,
+	OPERAND_LABEL, // RIP relative memory at a label
+} OperandKind;
+
+typedef struct {
+	OperandKind kind;
+	uint8_t size; // In bytes, 1, 4 or 8
+	Register base;
+	Register index;
+	bool hasIndex;
+	uint8_t scale;
+	int64_t value; // Immediate or displacement, also from a label
+	size_t label;
+} Operand;
+
+typedef struct {
+	const char * name;
+	size_t offset;
+	bool bound;
+	bool reserved; // offset is into the zeroed memory asked for with asmReserve
+	bool data;     // Bound right before asmData, it names bytes instead of code
+} Label;
+
+typedef struct {
+	size_t offset; // Where the rel32 field starts
+	size_t end;    // End of the instruction the field is relative to
+	size_t label;
+	int32_t addend;
+} Fixup;
+
+typedef struct {
+	uint8_t * items;
+	size_t count;
+	size_t capacity;
+} ByteArray;
+
+// Where the code for a place in the source starts
+typedef struct {
+	size_t offset;
+	const char * filePath;
+	size_t line;
+	size_t column;
+} SourceLine;
+
+typedef struct {
+	FILE * out; // nasm source goes here when set, otherwise machine code goes into code
+	ByteArray code;
+	struct {
+		Label * items;
+		size_t count;
+		size_t capacity;
+	} labels;
+	struct {
+		Fixup * items;
+		size_t count;
+		size_t capacity;
+	} fixups;
+	size_t lastBound;
+	size_t reservedSize;
+	size_t reservedOffset; // Where the zeroed memory starts relative to the code, set before asmResolve
+	bool lineInfo;         // asmLine records lines, or writes %line directives for nasm
+	struct {
+		SourceLine * items;
+		size_t count;
+		size_t capacity;
+	} lines;
+} Assembler;
+
+Operand r64(Register reg);
+Operand r32(Register reg);
+Operand r8(Register reg);
+Operand imm(int64_t value);
+Operand mem(uint8_t size, Register base, int32_t disp);
+Operand memIndex(uint8_t size, Register base, Register index, uint8_t scale, int32_t disp);
+Operand memLabel(uint8_t size, size_t label);
+Operand memLabelDisp(uint8_t size, size_t label, int32_t disp);
+
+void asmInit(Assembler * a, FILE * out);
+void asmFree(Assembler * a);
+size_t asmNewLabel(Assembler * a, const char * name);
+void asmBind(Assembler * a, size_t label);
+void asmGlobal(Assembler * a, size_t label);
+// Passes text straight through to the nasm source, there is nothing to encode for it
+void asmText(Assembler * a, const char * text);
+// Bytes that go into the code as they are, like tables the code reads
+void asmData(Assembler * a, const uint8_t * bytes, size_t count);
+// Binds label to size bytes of zeroed memory outside the code, nasm wants it in a .bss segment
+void asmReserve(Assembler * a, size_t label, size_t size);
+// The code from here on comes from line of filePath, until the next call
+void asmLine(Assembler * a, const char * filePath, size_t line, size_t column);
+void asmOp0(Assembler * a, Mnemonic mnemonic);
+void asmOp1(Assembler * a, Mnemonic mnemonic, Operand x);
+void asmOp2(Assembler * a, Mnemonic mnemonic, Operand dst, Operand src);
+void asmOp3(Assembler * a, Mnemonic mnemonic, Operand dst, Operand src, Operand extra);
+void asmJmp(Assembler * a, size_t label);
+void asmCall(Assembler * a, size_t label);
+void asmJcc(Assembler * a, Condition cc, size_t label);
+void asmSetcc(Assembler * a, Condition cc, Operand dst);
+void asmCmov(Assembler * a, Condition cc, Operand dst, Operand src);
+// Patches every jump and RIP relative reference, all labels have to be bound by now
+void asmResolve(Assembler * a);
+
+#endif // _X86_H